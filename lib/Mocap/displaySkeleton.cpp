@@ -12,68 +12,25 @@ Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 #include "motion.h"
 #include "displaySkeleton.h"
 
-////////////////SOFTWARE GL BEGIN///////////////////////
-#include <stack>
-stack<Matrix4> matrixStack;
-static Matrix4 currentMatrix = Matrix4::Identity();
-
-static Matrix4 toMatrix4(const Matrix3& A)
+static Real toRadians(double degrees)
 {
-  Matrix4 result = Matrix4::Identity();
-  for (int y = 0; y < 3; y++)
-    for (int x = 0; x < 3; x++)
-      result(x,y) = A(x,y);
-  return result;
+  return degrees * M_PI / 180.0;
 }
 
-static void myPushMatrix()
-{
-  matrixStack.push(currentMatrix);
-}
-static void myPopMatrix()
+// frame = frame * rotation about a coordinate axis, touching only the two
+// columns that change
+static void rotateAbout(Affine3D & frame, int axis, double degrees)
 {
-  assert(matrixStack.size() != 0);
-  currentMatrix = matrixStack.top();
-  matrixStack.pop();
+  Real c = cos(toRadians(degrees));
+  Real s = sin(toRadians(degrees));
+  int a = (axis + 1) % 3, b = (axis + 2) % 3;
+
+  Vector colA = frame.linear().col(a);
+  Vector colB = frame.linear().col(b);
+  frame.linear().col(a) = c * colA + s * colB;
+  frame.linear().col(b) = c * colB - s * colA;
 }
 
-static void myTranslatef(const float x, const float y, const float z)
-{
-  Matrix4 translation = Matrix4::Identity();
-  translation(3,0) = x;
-  translation(3,1) = y;
-  translation(3,2) = z;
-
-  currentMatrix = translation * currentMatrix;
-}
-static void myRotatef(const float degrees, const float x, const float y, const float z)
-{
-  Vector axis(x,y,z);
-  axis.normalize();
-  Matrix3 rotation;
-
-  float radians = (degrees / 360.0) * 2.0 * M_PI;
-  rotation = AngleAxis3D(radians, axis);
-  rotation.transposeInPlace();
-
-  currentMatrix = toMatrix4(rotation) * currentMatrix;
-}
-static void myMultMatrixd(const double* matrix)
-{
-  Matrix4 A;
-  int i = 0;
-  for (int x = 0; x < 4; x++)
-    for (int y = 0; y < 4; y++, i++)
-      A(x,y) = matrix[i];
-
-  currentMatrix = A * currentMatrix;
-}
-static void myLoadIdentity()
-{
-  currentMatrix = Matrix4::Identity();
-}
-////////////////SOFTWARE GL END///////////////////////
-
 float DisplaySkeleton::jointColors[NUMBER_JOINT_COLORS][3] =
 {
   {0.0f, 1.0f, 0.0f},  // GREEN
@@ -97,133 +54,153 @@ DisplaySkeleton::~DisplaySkeleton(void)
   Reset();
 }
 
+// Set the DOFs a posture animates, leaving the others as they are
+static void applyPosture(const PostureView * posture, double dofs[][6])
+{
+  for (int c = 0; c < posture->numChannels; c++)
+  {
+    int kind = posture->channels[c].kind;
+    if (kind >= 1 && kind <= 6)
+    {
+      // rotations come first in dofo codes, translations first here
+      dofs[posture->channels[c].bone][(kind <= 3) ? kind + 2 : kind - 4] = posture->values[c];
+    }
+  }
+}
+
+// The AMC rotation of a bone, z then y then x as rotateAbout applies them
+static Quaternion3D boneRotation(const Bone & bone, const double * d)
+{
+  Quaternion3D q = Quaternion3D::Identity();
+  if(bone.dofrz)
+    q = q * Quaternion3D(AngleAxis3D(toRadians(d[5]), Vector::UnitZ()));
+  if(bone.dofry)
+    q = q * Quaternion3D(AngleAxis3D(toRadians(d[4]), Vector::UnitY()));
+  if(bone.dofrx)
+    q = q * Quaternion3D(AngleAxis3D(toRadians(d[3]), Vector::UnitX()));
+  return q;
+}
+
 /*
-  Define M_k = Modelview matrix at the kth node (bone) in the heirarchy
-  M_k stores the transformation matrix of the kth bone in world coordinates
-  Our goal is to draw the (k+1)th bone, using its local information and M_k
+  Define M_k = transform of the kth node (bone) in the heirarchy, from its
+  local coordinates to world coordinates.
 
   In the k+1th node, compute the following matrices:
   rot_parent_current: this is the rotation matrix that
   takes us from k+1 to the kth local coordinate system
   R_k+1 : Rotation matrix for the k+1 th node (bone)
   using angles specified by the AMC file in local coordinates
-  T_k+1 : Translation matrix for the k+1th node
+  T_k : Translation along the kth bone, to where the k+1th starts
 
   The update relation is given by:
-  M_k+1 = M_k * (rot_parent_current) * R_k+1 + T_k+1
+  M_k+1 = M_k * T_k * (rot_parent_current) * R_k+1
+
+  Bones are visited parents first, so this is a single loop, and all state
+  lives on the stack or in the caller's array.
 */
-// TODO: Replace GL calls here with Eigen matrices
-void DisplaySkeleton::DrawBone(Bone *pBone,int skelNum)
+void DisplaySkeleton::ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView * from, const PostureView * to, Real t, Affine3D * transforms)
 {
-  static double z_dir[3] = {0.0, 0.0, 1.0};
-  double r_axis[3], theta;
-
-  //currentMatrix = getCurrentModelview();
-
-  //Transform (rotate) from the local coordinate system of this bone to it's parent
-  //This step corresponds to doing: ModelviewMatrix = M_k * (rot_parent_current)
-  myMultMatrixd((double*)&pBone->rot_parent_current);
-
-  //translate AMC (rarely used)
-  if(pBone->doftz)
-    myTranslatef(0.0f, 0.0f, float(pBone->tz));
-  if(pBone->dofty)
-    myTranslatef(0.0f, float(pBone->ty), 0.0f);
-  if(pBone->doftx)
-    myTranslatef(float(pBone->tx), 0.0f, 0.0f);
-
-  //rotate AMC
-  if(pBone->dofrz)
-    myRotatef(float(pBone->rz), 0.0f, 0.0f, 1.0f);
-  if(pBone->dofry)
-    myRotatef(float(pBone->ry), 0.0f, 1.0f, 0.0f);
-  if(pBone->dofrx)
-    myRotatef(float(pBone->rx), 1.0f, 0.0f, 0.0f);
-
-  //Store the current ModelviewMatrix (before adding the translation part)
-  myPushMatrix();
-
-  //Compute tx, ty, tz : translation from pBone to its child (in local coordinate system of pBone)
-  double tx = pBone->dir[0] * pBone->length;
-  double ty = pBone->dir[1] * pBone->length;
-  double tz = pBone->dir[2] * pBone->length;
-
-  // Use the current ModelviewMatrix to display the current bone
-  // Rotate the bone from its canonical position (elongated sphere
-  // with its major axis parallel to X axis) to its correct orientation
-  if(pBone->idx == Skeleton::getRootIndex())
+  // Translation and rotation DOFs of each bone, tx ty tz rx ry rz, at
+  // either end when blending
+  double dofs[MAX_BONES_IN_ASF_FILE][6];
+  double toDofs[MAX_BONES_IN_ASF_FILE][6];
+  // Where each bone's children start
+  Affine3D ends[MAX_BONES_IN_ASF_FILE];
+
+  const vector<int> & order = pSkeleton->getTraversalOrder();
+  for (size_t o = 0; o < order.size(); o++)
   {
-    // do nothing
+    Bone & bone = pSkeleton->getBone(order[o]);
+    double * d = dofs[bone.idx];
+    d[0] = bone.tx; d[1] = bone.ty; d[2] = bone.tz;
+    d[3] = bone.rx; d[4] = bone.ry; d[5] = bone.rz;
   }
-  else
+
+  if (to != NULL)
+    memcpy(toDofs, dofs, sizeof(dofs));
+  if (from != NULL)
+    applyPosture(from, dofs);
+  if (to != NULL)
+    applyPosture(to, toDofs);
+
+  // Placement of the whole skeleton
+  double translation[3];
+  pSkeleton->GetTranslation(translation);
+  double rotationAngle[3];
+  pSkeleton->GetRotationAngle(rotationAngle);
+
+  Affine3D base = Affine3D::Identity();
+  base.translate(Vector(MOCAP_SCALE * translation[0], MOCAP_SCALE * translation[1], MOCAP_SCALE * translation[2]));
+  rotateAbout(base, 0, rotationAngle[0]);
+  rotateAbout(base, 1, rotationAngle[1]);
+  rotateAbout(base, 2, rotationAngle[2]);
+
+  for (size_t o = 0; o < order.size(); o++)
   {
-    //Matrix4 currentTransform = getCurrentModelview();
-    Matrix4 currentTransform = currentMatrix;
-
-    //Compute the angle between the canonical pose and the correct orientation
-    //(specified in pBone->dir) using cross product.
-    //Using the formula: r_axis = z_dir x pBone->dir
-    r_axis[0] = z_dir[1]*pBone->dir[2]-z_dir[2]*pBone->dir[1];
-    r_axis[1] = z_dir[2]*pBone->dir[0]-z_dir[0]*pBone->dir[2];
-    r_axis[2] = z_dir[0]*pBone->dir[1]-z_dir[1]*pBone->dir[0];
-
-    double dot_prod = z_dir[0] * pBone->dir[0] + z_dir[1] * pBone->dir[1] + z_dir[2] * pBone->dir[2] ;
-    double r_axis_len = sqrt(r_axis[0] * r_axis[0] + r_axis[1] * r_axis[1] + r_axis[2] * r_axis[2]);
-    theta = atan2(r_axis_len, dot_prod);
-    Vector axis(r_axis[0], r_axis[1], r_axis[2]);
-    axis.normalize();
-    Matrix3 rotation;
-    rotation = AngleAxis3D(theta, axis);
-    rotation.transposeInPlace();
+    Bone & bone = pSkeleton->getBone(order[o]);
+    int parent = pSkeleton->getParent(bone.idx);
+    const double * d = dofs[bone.idx];
 
-    Matrix4 scaling = Matrix4::Identity();
-    scaling(0,0) = pBone->aspx;
-    scaling(1,1) = pBone->aspy;
-    boneScalings[pBone->idx] = scaling;
-
-    currentTransform = scaling * toMatrix4(rotation) * currentTransform;
-
-    Vec4 currentTranslation;
-    currentTranslation[0] = currentTransform(3,0);
-    currentTranslation[1] = currentTransform(3,1);
-    currentTranslation[2] = currentTransform(3,2);
-    currentTransform(3,0) = 0;
-    currentTransform(3,1) = 0;
-    currentTransform(3,2) = 0;
-
-    boneRotations[pBone->idx] = currentTransform.transpose();
-    boneTranslations[pBone->idx] = currentTranslation;
-  }
+    //Transform (rotate) from the local coordinate system of this bone to it's parent
+    Affine3D toParent = Affine3D::Identity();
+    for (int r = 0; r < 3; r++)
+    {
+      for (int c = 0; c < 3; c++)
+        toParent.linear()(r,c) = bone.rot_parent_current[c][r];
+      toParent.translation()[r] = bone.rot_parent_current[3][r];
+    }
 
-  myPopMatrix();
+    Affine3D frame = ((parent < 0) ? base : ends[parent]) * toParent;
+
+    //translate AMC (rarely used)
+    Vector shift(bone.doftx ? d[0] : 0, bone.dofty ? d[1] : 0, bone.doftz ? d[2] : 0);
+
+    if (to == NULL)
+    {
+      frame.translate(shift);
+
+      //rotate AMC
+      if(bone.dofrz)
+        rotateAbout(frame, 2, d[5]);
+      if(bone.dofry)
+        rotateAbout(frame, 1, d[4]);
+      if(bone.dofrx)
+        rotateAbout(frame, 0, d[3]);
+    }
+    else
+    {
+      const double * e = toDofs[bone.idx];
+      Vector toShift(bone.doftx ? e[0] : 0, bone.dofty ? e[1] : 0, bone.doftz ? e[2] : 0);
+      frame.translate(shift + t * (toShift - shift));
+      frame.linear() *= boneRotation(bone, d).slerp(t, boneRotation(bone, e)).toRotationMatrix();
+    }
 
-  // Finally, translate the bone, depending on its length and direction
-  // This step corresponds to doing: M_k+1 = ModelviewMatrix += T_k+1
-  myTranslatef(float(tx), float(ty), float(tz));
+    // The bone itself runs along z from the origin
+    transforms[bone.idx] = frame;
+    if (bone.idx != Skeleton::getRootIndex())
+      transforms[bone.idx].linear() *= pSkeleton->getAlignment(bone.idx);
+
+    //Translate to the end of the bone, depending on its length and direction
+    ends[bone.idx] = frame;
+    ends[bone.idx].translate(Vector(bone.dir[0] * bone.length, bone.dir[1] * bone.length, bone.dir[2] * bone.length));
+  }
 }
 
-//Traverse the hierarchy starting from the root
-//Every node in the data structure has just one child pointer.
-//If there are more than one children for any node, they are stored as sibling pointers
-//The algorithm draws the current node (bone), visits its child and then visits siblings
-// TODO: Replace GL calls here with Eigen matrices
-void DisplaySkeleton::Traverse(Bone *ptr,int skelNum)
+void DisplaySkeleton::ComputeBoneTransforms(Skeleton * pSkeleton, Affine3D * transforms)
 {
-  if(ptr != NULL)
-  {
-    myPushMatrix();
-
-    DrawBone(ptr,skelNum);
-    Traverse(ptr->child,skelNum);
+  ComputeBoneTransforms(pSkeleton, NULL, NULL, 0, transforms);
+}
 
-    myPopMatrix();
+void DisplaySkeleton::ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView & posture, Affine3D * transforms)
+{
+  ComputeBoneTransforms(pSkeleton, &posture, NULL, 0, transforms);
+}
 
-    Traverse(ptr->sibling,skelNum);
-  }
+void DisplaySkeleton::ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView & from, const PostureView & to, Real t, Affine3D * transforms)
+{
+  ComputeBoneTransforms(pSkeleton, &from, &to, t, transforms);
 }
 
-//Draw the skeleton
-// TODO: Replace GL calls here with Eigen matrices
 void DisplaySkeleton::ComputeBonePositions(RenderMode renderMode_)
 {
   unsigned int numbones = m_pSkeleton[0]->numBonesInSkel(*m_pSkeleton[0]->getRoot());
@@ -233,6 +210,7 @@ void DisplaySkeleton::ComputeBonePositions(RenderMode renderMode_)
     boneTranslations.resize(numbones);
     boneScalings.resize(numbones);
     boneLengths.resize(numbones);
+    boneTransforms.resize(MAX_BONES_IN_ASF_FILE);
     for (unsigned int x = 0; x < numbones; x++)
       boneLengths[x] = m_pSkeleton[0]->getBone(x).length;
   }
@@ -240,32 +218,25 @@ void DisplaySkeleton::ComputeBonePositions(RenderMode renderMode_)
   // Set render mode
   renderMode = renderMode_;
 
-  myPushMatrix();
+  ComputeBoneTransforms(m_pSkeleton[0], &boneTransforms[0]);
 
-  // load up identity so we just get the pure transforms out at the end,
-  // not the modelview as well
-  myLoadIdentity();
-
-  //draw the skeleton starting from the root
-  for (int i = 0; i < numSkeletons; i++)
+  // Split into rotation (with the bone's aspect ratio) and translation,
+  // skipping the root
+  for (unsigned int x = 1; x < numbones; x++)
   {
-    myPushMatrix();
-
-    double translation[3];
-    m_pSkeleton[i]->GetTranslation(translation);
-    double rotationAngle[3];
-    m_pSkeleton[i]->GetRotationAngle(rotationAngle);
+    Bone & bone = m_pSkeleton[0]->getBone(x);
 
-    myTranslatef(float(MOCAP_SCALE * translation[0]), float(MOCAP_SCALE * translation[1]), float(MOCAP_SCALE * translation[2]));
-    myRotatef(float(rotationAngle[0]), 1.0f, 0.0f, 0.0f);
-    myRotatef(float(rotationAngle[1]), 0.0f, 1.0f, 0.0f);
-    myRotatef(float(rotationAngle[2]), 0.0f, 0.0f, 1.0f);
+    Matrix4 scaling = Matrix4::Identity();
+    scaling(0,0) = bone.aspx;
+    scaling(1,1) = bone.aspy;
+    boneScalings[x] = scaling;
 
-    Traverse(m_pSkeleton[i]->getRoot(),i);
+    Matrix4 rotation = Matrix4::Identity();
+    rotation.block<3,3>(0,0) = boneTransforms[x].linear() * scaling.block<3,3>(0,0);
+    boneRotations[x] = rotation;
 
-    myPopMatrix();
+    boneTranslations[x] << boneTransforms[x].translation(), 0;
   }
-  myPopMatrix();
 }
 
 void DisplaySkeleton::LoadMotion(Motion * pMotion)
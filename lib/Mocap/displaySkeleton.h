@@ -41,9 +41,20 @@ public:
   //set motion for display
   void LoadMotion(Motion * pMotion);
 
-  //display the scene (skeleton, ground plane ....)
+  //pose the first skeleton, filling rotations(), scalings() and translations()
   void ComputeBonePositions(RenderMode renderMode);
 
+  // Forward kinematics into the caller's transforms, indexed by bone. Each
+  // bone's frame has the bone start at its origin and run along z; the root
+  // gets its own frame. Takes the pose from the skeleton, or from a frame of
+  // its motion without touching the skeleton, and keeps no state of its own,
+  // so any number of skeletons can be posed at once from different threads.
+  static void ComputeBoneTransforms(Skeleton * pSkeleton, Affine3D * transforms);
+  static void ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView & posture, Affine3D * transforms);
+  // Part way between two frames, t from 0 at the first to 1 at the second.
+  // Each bone's rotation is slerped and its translation blended linearly.
+  static void ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView & from, const PostureView & to, Real t, Affine3D * transforms);
+
   void SetDisplayedSpotJoint(int jointID) {m_SpotJoint = jointID;}
   int GetDisplayedSpotJoint(void) {return m_SpotJoint;}
   int GetNumSkeletons(void) {return numSkeletons;}
@@ -59,10 +70,7 @@ public:
 
 protected:
   RenderMode renderMode;
-  // Draw a particular bone
-  void DrawBone(Bone *ptr, int skelNum);
-  // Draw the skeleton hierarchy
-  void Traverse(Bone *ptr, int skelNum);
+  static void ComputeBoneTransforms(Skeleton * pSkeleton, const PostureView * from, const PostureView * to, Real t, Affine3D * transforms);
 
   int m_SpotJoint;		//joint whose local coordinate framework is drawn
   int numSkeletons;
@@ -75,6 +83,7 @@ protected:
   vector<Matrix4> boneScalings;
   vector<Vec4> boneTranslations;
   vector<float> boneLengths;
+  vector<Affine3D> boneTransforms;
 };
 
 #endif
@@ -10,6 +10,13 @@ Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 #include <fstream>
 #include <math.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "skeleton.h"
 #include "motion.h"
@@ -19,9 +26,12 @@ Motion::Motion(int numFrames_, Skeleton * pSkeleton_)
 {
   pSkeleton = pSkeleton_;
   m_NumFrames = numFrames_;
+  m_pChannels = NULL;
+  m_pValues = NULL;
+  m_pMapping = NULL;
 
-  //allocate postures array
-  m_pPostures = new Posture[m_NumFrames];
+  SetChannelsFromSkeleton();
+  AllocateValues();
 
   //Set all postures to default posture
   SetPosturesToDefault();
@@ -31,184 +41,395 @@ Motion::Motion(const char *amc_filename, double scale, Skeleton * pSkeleton_)
 {
   pSkeleton = pSkeleton_;
   m_NumFrames = 0;
-  m_pPostures = NULL;
+  m_NumChannels = 0;
+  m_pChannels = NULL;
+  m_pValues = NULL;
+  m_pMapping = NULL;
 
-  int code = readAMCfile(amc_filename, scale);	
+  if (readCache(amc_filename, scale))
+    return;
+
+  int code = readAMCfile(amc_filename, scale);
   if (code < 0)
     throw 1;
 }
 
 Motion::~Motion()
 {
-  if (m_pPostures != NULL)
-    delete [] m_pPostures;
+  if (m_pChannels != NULL)
+    delete [] m_pChannels;
+
+  if (m_pMapping != NULL)
+    munmap(m_pMapping, m_MappingSize);
+  else if (m_pValues != NULL)
+    delete [] m_pValues;
+}
+
+void Motion::SetChannelsFromSkeleton()
+{
+  Bone * bone = pSkeleton->getRoot();
+  int numbones = pSkeleton->numBonesInSkel(bone[0]);
+
+  std::vector<MotionChannel> channels;
+  for (int j = 0; j < numbones; j++)
+  {
+    for (int x = 0; x < bone[j].dof; x++)
+    {
+      MotionChannel channel;
+      channel.bone = j;
+      channel.kind = bone[j].dofo[x];
+      channels.push_back(channel);
+    }
+  }
+
+  if (m_pChannels != NULL)
+    delete [] m_pChannels;
+
+  m_NumChannels = channels.size();
+  m_pChannels = new MotionChannel[m_NumChannels];
+  for (int c = 0; c < m_NumChannels; c++)
+    m_pChannels[c] = channels[c];
+}
+
+void Motion::AllocateValues()
+{
+  m_pValues = new float[(size_t) m_NumFrames * m_NumChannels];
 }
 
 //Set all postures to default posture
 void Motion::SetPosturesToDefault()
 {
-  for (int frame = 0; frame<m_NumFrames; frame++)
-  {
-    //set root position to (0,0,0)
-    m_pPostures[frame].root_pos.setValue(0.0, 0.0, 0.0);
-    //set each bone orientation to (0,0,0)
-    for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++)
-      m_pPostures[frame].bone_rotation[j].setValue(0.0, 0.0, 0.0);
+  //root position at (0,0,0), every bone orientation (0,0,0)
+  for (size_t v = 0; v < (size_t) m_NumFrames * m_NumChannels; v++)
+    m_pValues[v] = 0;
+}
 
+float * Motion::ChannelValue(int frameIndex, int boneIndex, int kind)
+{
+  for (int c = 0; c < m_NumChannels; c++)
+  {
+    if (m_pChannels[c].bone == boneIndex && m_pChannels[c].kind == kind)
+      return &m_pValues[(size_t) frameIndex * m_NumChannels + c];
   }
+  return NULL;
 }
 
 //Set posture at spesified frame
-void Motion::SetPosture(int frameIndex, Posture InPosture)
+void Motion::SetPosture(int frameIndex, const Posture & InPosture)
 {
-  m_pPostures[frameIndex] = InPosture; 	
+  float * values = &m_pValues[(size_t) frameIndex * m_NumChannels];
+  for (int c = 0; c < m_NumChannels; c++)
+  {
+    int j = m_pChannels[c].bone;
+    int kind = m_pChannels[c].kind;
+    if (kind >= 1 && kind <= 3)
+      values[c] = InPosture.bone_rotation[j].p[kind - 1];
+    else if (kind >= 4 && kind <= 6)
+      values[c] = (j == Skeleton::getRootIndex()) ? InPosture.root_pos.p[kind - 4] : InPosture.bone_translation[j].p[kind - 4];
+    else if (kind == 7)
+      values[c] = InPosture.bone_length[j].p[0];
+  }
 }
 
 void Motion::SetBoneRotation(int frameIndex, int boneIndex, bonevector vRot)
 {
-  m_pPostures[frameIndex].bone_rotation[boneIndex] = vRot;
+  for (int x = 0; x < 3; x++)
+  {
+    float * value = ChannelValue(frameIndex, boneIndex, x + 1);
+    if (value != NULL)
+      *value = vRot.p[x];
+  }
 }
 
 void Motion::SetRootPos(int frameIndex, bonevector vPos)
 {
-  m_pPostures[frameIndex].root_pos = vPos;
+  for (int x = 0; x < 3; x++)
+  {
+    float * value = ChannelValue(frameIndex, Skeleton::getRootIndex(), x + 4);
+    if (value != NULL)
+      *value = vPos.p[x];
+  }
 }
 
-Posture * Motion::GetPosture(int frameIndex)
+const float * Motion::GetFrame(int frameIndex)
 {
   if (frameIndex < 0 || frameIndex >= m_NumFrames)
   {
-    printf("Error in Motion::GetPosture: frame index %d is illegal.\n", frameIndex);
+    printf("Error in Motion::GetFrame: frame index %d is illegal.\n", frameIndex);
     printf("m_NumFrames = %d\n", m_NumFrames);
     exit(0);
   }
-  return &(m_pPostures[frameIndex]);
+  return &m_pValues[(size_t) frameIndex * m_NumChannels];
 }
 
-int Motion::readAMCfile(const char* name, double scale)
+PostureView Motion::GetPostureView(int frameIndex)
 {
-  Bone *hroot, *bone;
-  bone = hroot = pSkeleton->getRoot();
+  PostureView view;
+  view.channels = m_pChannels;
+  view.values = GetFrame(frameIndex);
+  view.numChannels = m_NumChannels;
+  return view;
+}
 
-  std::ifstream file( name, std::ios::in );
-  if( file.fail() ) 
-    return -1;
+void Motion::GetPosture(int frameIndex, Posture * posture)
+{
+  if (frameIndex < 0 || frameIndex >= m_NumFrames)
+  {
+    printf("Error in Motion::GetPosture: frame index %d is illegal.\n", frameIndex);
+    printf("m_NumFrames = %d\n", m_NumFrames);
+    exit(0);
+  }
 
-  int n=0;
-  char str[2048];
+  // Everything without a channel stays zero
+  for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++)
+  {
+    posture->bone_rotation[j].setValue(0.0, 0.0, 0.0);
+    posture->bone_translation[j].setValue(0.0, 0.0, 0.0);
+    posture->bone_length[j].setValue(0.0, 0.0, 0.0);
+  }
 
-  // count the number of lines
-  while(!file.eof())  
+  const float * values = &m_pValues[(size_t) frameIndex * m_NumChannels];
+  for (int c = 0; c < m_NumChannels; c++)
   {
-    file.getline(str, 2048);
-    if(file.eof()) break;
-    //We do not want to count empty lines
-    if (strcmp(str, "") != 0)
-      n++;
+    int j = m_pChannels[c].bone;
+    int kind = m_pChannels[c].kind;
+    if (kind >= 1 && kind <= 3)
+      posture->bone_rotation[j].p[kind - 1] = values[c];
+    else if (kind >= 4 && kind <= 6)
+      posture->bone_translation[j].p[kind - 4] = values[c];
+    else if (kind == 7)
+      posture->bone_length[j].p[0] = values[c];
   }
 
-  file.close();
+  int root = Skeleton::getRootIndex();
+  posture->root_pos = posture->bone_translation[root];
+}
 
-  //Compute number of frames. 
-  //Subtract 3 to  ignore the header
-  //There are (NUM_BONES_IN_ASF_FILE - 2) moving bones and 2 dummy bones (lhipjoint and rhipjoint)
-  int numbones = pSkeleton->numBonesInSkel(bone[0]);
-  int movbones = pSkeleton->movBonesInSkel(bone[0]);
-  n = (n-3)/((movbones) + 1);   
+// Null-terminates the next whitespace separated token and moves past it
+static char * nextToken(char *& p)
+{
+  while (*p != '\0' && isspace((unsigned char) *p))
+    p++;
+  if (*p == '\0')
+    return NULL;
+
+  char * token = p;
+  while (*p != '\0' && !isspace((unsigned char) *p))
+    p++;
+  if (*p != '\0')
+    *p++ = '\0';
+  return token;
+}
 
-  m_NumFrames = n;
+// Reads the whole file in one pass, frames are counted as they come
+int Motion::readAMCfile(const char* name, double scale)
+{
+  Bone * bone = pSkeleton->getRoot();
 
-  //Allocate memory for state bonevector
-  m_pPostures = new Posture[m_NumFrames]; 
+  FILE * fp = fopen(name, "rb");
+  if (fp == NULL)
+    return -1;
 
-  //Set all postures to default posture
-  SetPosturesToDefault();
+  std::vector<char> text;
+  char block[65536];
+  size_t got;
+  while ((got = fread(block, 1, sizeof(block), fp)) > 0)
+    text.insert(text.end(), block, block + got);
+  fclose(fp);
+  text.push_back('\0');
 
-  file.open(name);
+  char * p = &text[0];
+  char * token;
 
   // process the header (add rotational DOFs to skeleton if requested)
-  while (1) 
+  bool allJoints3DOF = false;
+  while ((token = nextToken(p)) != NULL)
   {
-    file >> str;
-
-    if(strcmp(str, ":FORCE-ALL-JOINTS-BE-3DOF") == 0) 
+    if (strcmp(token, ":FORCE-ALL-JOINTS-BE-3DOF") == 0)
+    {
       pSkeleton->enableAllRotationalDOFs();
+      allJoints3DOF = true;
+    }
 
-    if(strcmp(str, ":DEGREES") == 0) 
+    if (strcmp(token, ":DEGREES") == 0)
       break;
   }
 
-  for(int i=0; i<m_NumFrames; i++)
-  {
-    //read frame number
-    int frame_num;
-    file >> frame_num;
+  SetChannelsFromSkeleton();
 
-    //There are (NUM_BONES_IN_ASF_FILE - 2) movable bones and 2 dummy bones (lhipjoint and rhipjoint)
-    for(int j=0; j<movbones; j++)
-    {
-      //read bone name
-      file >> str;
+  int numbones = pSkeleton->numBonesInSkel(bone[0]);
+  std::vector<int> firstChannel(numbones, -1);
+  for (int c = m_NumChannels - 1; c >= 0; c--)
+    firstChannel[m_pChannels[c].bone] = c;
 
-      //fine the bone index corresponding to the bone name
-      int bone_idx; 
-      for( bone_idx = 0; bone_idx < numbones; bone_idx++ )
-        if( strcmp( str, pSkeleton->idx2name(bone_idx) ) == 0 ) 
-          break;
+  std::vector<float> values;
+  int n = 0;
+  int lastBone = -1;
 
-      //init rotation angles for this bone to (0, 0, 0)
-      m_pPostures[i].bone_rotation[bone_idx].setValue(0.0, 0.0, 0.0);
+  while ((token = nextToken(p)) != NULL)
+  {
+    // frame number
+    if (isdigit((unsigned char) token[0]))
+    {
+      n++;
+      values.resize((size_t) n * m_NumChannels, 0.0f);
+      lastBone = -1;
+      continue;
+    }
 
-      for(int x = 0; x < bone[bone_idx].dof; x++)
-      {
-        double tmp;
-        file >> tmp;
-        //	printf("%d %f\n",bone[bone_idx].dofo[x],tmp);
-        switch (bone[bone_idx].dofo[x]) 
-        {
-        case 0:
-          printf("FATAL ERROR in bone %d not found %d\n",bone_idx,x);
-          x = bone[bone_idx].dof;
-          break;
-        case 1:
-          m_pPostures[i].bone_rotation[bone_idx].p[0] = tmp;
-          break;
-        case 2:
-          m_pPostures[i].bone_rotation[bone_idx].p[1] = tmp;
-          break;
-        case 3:
-          m_pPostures[i].bone_rotation[bone_idx].p[2] = tmp;
-          break;
-        case 4:
-          m_pPostures[i].bone_translation[bone_idx].p[0] = tmp * scale;
-          break;
-        case 5:
-          m_pPostures[i].bone_translation[bone_idx].p[1] = tmp * scale;
-          break;
-        case 6:
-          m_pPostures[i].bone_translation[bone_idx].p[2] = tmp * scale;
-          break;
-        case 7:
-          m_pPostures[i].bone_length[bone_idx].p[0] = tmp;// * scale;
+    if (n == 0)
+      continue;
+
+    // bones come in the same order every frame, so try the one after the
+    // last first
+    int bone_idx = lastBone + 1;
+    if (bone_idx >= numbones || strcmp(token, pSkeleton->idx2name(bone_idx)) != 0)
+    {
+      for (bone_idx = 0; bone_idx < numbones; bone_idx++)
+        if (strcmp(token, pSkeleton->idx2name(bone_idx)) == 0)
           break;
-        }
-      }
-      if( strcmp( str, "root" ) == 0 ) 
-      {
-        m_pPostures[i].root_pos.p[0] = m_pPostures[i].bone_translation[0].p[0];// * scale;
-        m_pPostures[i].root_pos.p[1] = m_pPostures[i].bone_translation[0].p[1];// * scale;
-        m_pPostures[i].root_pos.p[2] = m_pPostures[i].bone_translation[0].p[2];// * scale;
-      }
+    }
+
+    if (bone_idx == numbones)
+    {
+      printf("Error in Motion::readAMCfile: unknown bone '%s' in '%s'.\n", token, name);
+      return -1;
+    }
+    lastBone = bone_idx;
 
-      // read joint angles, including root orientation
+    float * frame = &values[(size_t) (n - 1) * m_NumChannels];
+    for (int x = 0; x < bone[bone_idx].dof; x++)
+    {
+      double tmp = strtod(p, &p);
+      int c = firstChannel[bone_idx] + x;
+      int kind = m_pChannels[c].kind;
+
+      if (kind >= 4 && kind <= 6)
+        tmp *= scale;
+      else if (kind == 0)
+        printf("FATAL ERROR in bone %d not found %d\n", bone_idx, x);
+      frame[c] = tmp;
     }
   }
 
-  file.close();
+  m_NumFrames = n;
+  AllocateValues();
+  if (!values.empty())
+    memcpy(m_pValues, &values[0], values.size() * sizeof(float));
+
+  writeCache(name, scale, allJoints3DOF);
+
   printf("%d samples in '%s' are read.\n", n, name);
   return n;
 }
 
+bool Motion::readCache(const char* name, double scale)
+{
+  struct stat source;
+  if (stat(name, &source) != 0)
+    return false;
+
+  std::string cacheName = std::string(name) + ".cache";
+  int fd = open(cacheName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+  if (size < sizeof(MotionCacheHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  // Private and writable, so SetPosture and friends only change our copy
+  void * mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  const MotionCacheHeader * header = (const MotionCacheHeader *) mapping;
+  bool valid = memcmp(header->magic, MOTION_CACHE_MAGIC, 4) == 0 &&
+    header->version == MOTION_CACHE_VERSION &&
+    header->scale == scale &&
+    header->sourceSize == (uint64_t) source.st_size &&
+    header->sourceMtime == (int64_t) source.st_mtime &&
+    size == sizeof(MotionCacheHeader) + header->numChannels * sizeof(MotionChannel) +
+      (size_t) header->numFrames * header->numChannels * sizeof(float);
+
+  if (valid)
+  {
+    if (header->allJoints3DOF)
+      pSkeleton->enableAllRotationalDOFs();
+
+    // The skeleton has to animate the same DOFs the cache was made for
+    SetChannelsFromSkeleton();
+    valid = header->numChannels == (uint32_t) m_NumChannels &&
+      memcmp((const char *) mapping + sizeof(MotionCacheHeader), m_pChannels, m_NumChannels * sizeof(MotionChannel)) == 0;
+  }
+
+  if (!valid)
+  {
+    munmap(mapping, size);
+    return false;
+  }
+
+  m_NumFrames = header->numFrames;
+  m_pMapping = mapping;
+  m_MappingSize = size;
+  m_pValues = (float *) ((char *) mapping + sizeof(MotionCacheHeader) + m_NumChannels * sizeof(MotionChannel));
+
+  printf("%d samples in '%s' are mapped.\n", m_NumFrames, cacheName.c_str());
+  return true;
+}
+
+// Best effort, a motion that can't be cached is parsed again next time
+void Motion::writeCache(const char* name, double scale, bool allJoints3DOF)
+{
+  struct stat source;
+  if (stat(name, &source) != 0)
+    return;
+
+  MotionCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MOTION_CACHE_MAGIC, 4);
+  header.version = MOTION_CACHE_VERSION;
+  header.numFrames = m_NumFrames;
+  header.numChannels = m_NumChannels;
+  header.scale = scale;
+  header.sourceSize = source.st_size;
+  header.sourceMtime = source.st_mtime;
+  header.allJoints3DOF = allJoints3DOF;
+
+  // Written aside and renamed, so a reader never maps half a file. The temp
+  // file is unique so processes caching the same motion don't share it.
+  std::string cacheName = std::string(name) + ".cache";
+  std::vector<char> tempName(cacheName.begin(), cacheName.end());
+  const char * suffix = ".XXXXXX";
+  tempName.insert(tempName.end(), suffix, suffix + strlen(suffix) + 1);
+  int fd = mkstemp(&tempName[0]);
+  if (fd < 0)
+    return;
+  fchmod(fd, 0644);
+  FILE * fp = fdopen(fd, "wb");
+  if (fp == NULL)
+  {
+    close(fd);
+    unlink(&tempName[0]);
+    return;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  ok = ok && fwrite(m_pChannels, sizeof(MotionChannel), m_NumChannels, fp) == (size_t) m_NumChannels;
+  size_t count = (size_t) m_NumFrames * m_NumChannels;
+  ok = ok && fwrite(m_pValues, sizeof(float), count, fp) == count;
+  ok = (fclose(fp) == 0) && ok;
+
+  if (!ok || rename(&tempName[0], cacheName.c_str()) != 0)
+    unlink(&tempName[0]);
+}
+
 int Motion::writeAMCfile(char * filename, double scale, int forceAllJointsBe3DOF)
 {
   Bone * bone = pSkeleton->getRoot();
@@ -226,16 +447,19 @@ int Motion::writeAMCfile(char * filename, double scale, int forceAllJointsBe3DOF
   int numbones = pSkeleton->numBonesInSkel(bone[0]);
 
   int root = Skeleton::getRootIndex();
+  Posture frame;
+  Posture * posture = &frame;
   for(int f=0; f < m_NumFrames; f++)
   {
+    GetPosture(f, posture);
     os << f+1 << std::endl;
     os << "root " 
-       << m_pPostures[f].root_pos.p[0] / scale << " " 
-       << m_pPostures[f].root_pos.p[1] / scale << " " 
-       << m_pPostures[f].root_pos.p[2] / scale << " " 
-       << m_pPostures[f].bone_rotation[root].p[0] << " " 
-       << m_pPostures[f].bone_rotation[root].p[1] << " " 
-       << m_pPostures[f].bone_rotation[root].p[2] ;
+       << posture->root_pos.p[0] / scale << " " 
+       << posture->root_pos.p[1] / scale << " " 
+       << posture->root_pos.p[2] / scale << " " 
+       << posture->bone_rotation[root].p[0] << " " 
+       << posture->bone_rotation[root].p[1] << " " 
+       << posture->bone_rotation[root].p[2] ;
 
     for(int j = 2; j < numbones; j++) 
     {
@@ -254,7 +478,7 @@ int Motion::writeAMCfile(char * filename, double scale, int forceAllJointsBe3DOF
           {
             // if enabled, output the DOF
             if(bone[j].dofrx == 1) 
-              os << " " << m_pPostures[f].bone_rotation[j].p[0];
+              os << " " << posture->bone_rotation[j].p[0];
           }
 
           // is this DOF ry ?
@@ -262,7 +486,7 @@ int Motion::writeAMCfile(char * filename, double scale, int forceAllJointsBe3DOF
           {
             // if enabled, output the DOF
             if(bone[j].dofry == 1) 
-              os << " " << m_pPostures[f].bone_rotation[j].p[1];
+              os << " " << posture->bone_rotation[j].p[1];
           }
 
           // is this DOF rz ?
@@ -270,7 +494,7 @@ int Motion::writeAMCfile(char * filename, double scale, int forceAllJointsBe3DOF
           {
             // if enabled, output the DOF
             if(bone[j].dofrz == 1) 
-              os << " " << m_pPostures[f].bone_rotation[j].p[2];
+              os << " " << posture->bone_rotation[j].p[2];
           }
         }
       }
@@ -21,6 +21,26 @@ Revision 3 - Jernej Barbic and Yili Zhao, Feb 2012
 #include "posture.h"
 #include "skeleton.h"
 #include "SETTINGS.hpp"
+#include <stdint.h>
+
+// Binary cache of a parsed AMC file (<amc file>.cache), mmap'd on later loads.
+// It is rebuilt whenever the AMC file, the scale or the skeleton's DOFs change.
+#define MOTION_CACHE_MAGIC "AMCC"
+#define MOTION_CACHE_VERSION 1
+
+struct MotionCacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t numFrames;
+  uint32_t numChannels;
+  double scale;
+  uint64_t sourceSize;
+  int64_t sourceMtime;
+  uint32_t allJoints3DOF; // :FORCE-ALL-JOINTS-BE-3DOF was in the header
+  uint32_t pad;
+  // followed by numChannels MotionChannels, then numFrames * numChannels floats
+};
 
 class Motion
 {
@@ -46,7 +66,7 @@ public:
   void SetPosturesToDefault();
 
   //Set the entire posture at specified frame (posture = root position and all bone rotations)
-  void SetPosture(int frameIndex, Posture InPosture);
+  void SetPosture(int frameIndex, const Posture & InPosture);
 
   //Set root position at specified frame
   void SetRootPos(int frameIndex, bonevector vPos);
@@ -54,18 +74,42 @@ public:
   void SetBoneRotation(int frameIndex, int boneIndex, bonevector vRot);
 
   int GetNumFrames() { return m_NumFrames; }
-  Posture * GetPosture(int frameIndex);
+  // Expands the frame's channels into posture, DOFs without a channel are
+  // set to zero
+  void GetPosture(int frameIndex, Posture * posture);
+
+  int GetNumChannels() { return m_NumChannels; }
+  const MotionChannel * GetChannels() { return m_pChannels; }
+  // The frame's channel values, in the order of GetChannels()
+  const float * GetFrame(int frameIndex);
+  // The frame in place, for Skeleton::setPosture
+  PostureView GetPostureView(int frameIndex);
 
   Skeleton * GetSkeleton() { return pSkeleton; }
 
 protected:
   int m_NumFrames; //number of frames in the motion
   Skeleton * pSkeleton;
-  //Root position and all bone rotation angles for each frame (as read from AMC file)
-  Posture * m_pPostures;
+
+  // Only the DOFs the skeleton animates are stored, as float channels, one
+  // frame after the other
+  int m_NumChannels;
+  MotionChannel * m_pChannels;
+  float * m_pValues;
+
+  // Set when the channels are mmap'd from the cache instead of owned
+  void * m_pMapping;
+  size_t m_MappingSize;
+
+  // Channels for every DOF of the skeleton
+  void SetChannelsFromSkeleton();
+  void AllocateValues();
+  float * ChannelValue(int frameIndex, int boneIndex, int kind);
 
   // The default value is 0.06
   int readAMCfile(const char* name, double scale);
+  bool readCache(const char* name, double scale);
+  void writeCache(const char* name, double scale, bool allJoints3DOF);
 };
 
 #endif
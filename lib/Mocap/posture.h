@@ -8,6 +8,7 @@ Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 
 #include "bonevector.h"
 #include "SETTINGS.hpp"
+#include <stdint.h>
 
 //Root position and all bone rotation angles (including root)
 struct Posture
@@ -29,4 +30,21 @@ public:
   bonevector bone_length[MAX_BONES_IN_ASF_FILE];
 };
 
+// One animated degree of freedom of a bone. kind is the bone's dofo code:
+// 1-3 rotation x/y/z, 4-6 translation x/y/z, 7 length.
+struct MotionChannel
+{
+  int32_t bone;
+  int32_t kind;
+};
+
+// A frame of a motion as it is stored, without expanding it into a Posture
+// (see Motion::GetPostureView)
+struct PostureView
+{
+  const MotionChannel * channels;
+  const float * values;
+  int numChannels;
+};
+
 #endif
@@ -139,7 +139,7 @@ int Skeleton::readASFfile(const char* asf_filename, double scale)
   //
   is.getline(str, 2048);
   removeCR(str);
-  char	part[256], *token;
+  char	part[256], *token, *save; // strtok_r keeps parsing re-entrant for concurrent loads
   double length;
 
   bool done = false;
@@ -198,7 +198,7 @@ int Skeleton::readASFfile(const char* asf_filename, double scale)
       // this line describes the bone's dof
       if(strcmp(keyword, "dof") == 0)
       {
-        token=strtok(str, " ");
+        token=strtok_r(str, " ", &save);
         m_pBoneList[i].dof=0;
         while(token != NULL)
         {
@@ -217,7 +217,7 @@ int Skeleton::readASFfile(const char* asf_filename, double scale)
           m_pBoneList[i].dof++;
           m_pBoneList[i].dofo[m_pBoneList[i].dof] = 0;
           end:
-            token=strtok(NULL, " ");
+            token=strtok_r(NULL, " ", &save);
         }
         // printf("Bone %d DOF: ",i);
         // for (int x = 0; (x < 7) && (m_pBoneList[i].dofo[x] != 0); x++)
@@ -267,7 +267,7 @@ int Skeleton::readASFfile(const char* asf_filename, double scale)
     else
     {
       //parse this line, it contains parent followed by children
-      part_name=strtok(str, " ");
+      part_name=strtok_r(str, " ", &save);
       j=0;
       while(part_name != NULL)
       {
@@ -275,7 +275,7 @@ int Skeleton::readASFfile(const char* asf_filename, double scale)
           parent=name2idx(part_name);
         else
           setChildrenAndSibling(parent, &m_pBoneList[name2idx(part_name)]);
-        part_name=strtok(NULL, " ");
+        part_name=strtok_r(NULL, " ", &save);
         j++;
       }
     }
@@ -295,19 +295,16 @@ when this function first called
 */
 Bone* Skeleton::getBone(Bone *ptr, int bIndex)
 {
-  static Bone *theptr;
   if(ptr==NULL)
     return(NULL);
   else if(ptr->idx == bIndex)
-  {
-    theptr=ptr;
-    return(theptr);
-  }
+    return(ptr);
   else
   {
-    getBone(ptr->child, bIndex);
-    getBone(ptr->sibling, bIndex);
-    return(theptr);
+    Bone *found = getBone(ptr->child, bIndex);
+    if(found == NULL)
+      found = getBone(ptr->sibling, bIndex);
+    return(found);
   }
 }
 
@@ -515,7 +512,7 @@ void Skeleton::enableAllRotationalDOFs()
 }
 
 // set the skeleton's pose based on the given posture
-void Skeleton::setPosture(Posture posture)
+void Skeleton::setPosture(const Posture & posture)
 {
   m_RootPos[0] = posture.root_pos.p[0];
   m_RootPos[1] = posture.root_pos.p[1];
@@ -549,6 +546,45 @@ void Skeleton::setPosture(Posture posture)
   }
 }
 
+void Skeleton::setPosture(const PostureView & posture)
+{
+  int root = getRootIndex();
+
+  for(int c=0;c<posture.numChannels;c++)
+  {
+    Bone & bone = m_pBoneList[posture.channels[c].bone];
+    double value = posture.values[c];
+
+    switch (posture.channels[c].kind)
+    {
+    case 1:
+      if(bone.dofrx) bone.rx = value;
+      break;
+    case 2:
+      if(bone.dofry) bone.ry = value;
+      break;
+    case 3:
+      if(bone.dofrz) bone.rz = value;
+      break;
+    case 4:
+      if(bone.doftx) bone.tx = value;
+      if(bone.idx == root) m_RootPos[0] = value;
+      break;
+    case 5:
+      if(bone.dofty) bone.ty = value;
+      if(bone.idx == root) m_RootPos[1] = value;
+      break;
+    case 6:
+      if(bone.doftz) bone.tz = value;
+      if(bone.idx == root) m_RootPos[2] = value;
+      break;
+    case 7:
+      if(bone.doftl) bone.tl = value;
+      break;
+    }
+  }
+}
+
 //Set the aspect ratio of each bone
 void Skeleton::set_bone_shape(Bone *bone)
 {
@@ -608,6 +644,62 @@ Skeleton::Skeleton(const char *asf_filename, double scale)
 
   //Set the aspect ratio of each bone
   set_bone_shape(m_pRootBone);
+
+  computeTraversalOrder();
+}
+
+// Rotation taking the z axis onto the bone's direction
+static Matrix3 alignToBone(const Bone & bone)
+{
+  static double z_dir[3] = {0.0, 0.0, 1.0};
+  double r_axis[3];
+
+  //Compute the angle between the canonical pose and the correct orientation
+  //(specified in bone.dir) using cross product.
+  //Using the formula: r_axis = z_dir x bone.dir
+  r_axis[0] = z_dir[1]*bone.dir[2]-z_dir[2]*bone.dir[1];
+  r_axis[1] = z_dir[2]*bone.dir[0]-z_dir[0]*bone.dir[2];
+  r_axis[2] = z_dir[0]*bone.dir[1]-z_dir[1]*bone.dir[0];
+
+  double dot_prod = z_dir[0] * bone.dir[0] + z_dir[1] * bone.dir[1] + z_dir[2] * bone.dir[2] ;
+  double r_axis_len = sqrt(r_axis[0] * r_axis[0] + r_axis[1] * r_axis[1] + r_axis[2] * r_axis[2]);
+  double theta = atan2(r_axis_len, dot_prod);
+  Vector axis(r_axis[0], r_axis[1], r_axis[2]);
+  axis.normalize();
+
+  Matrix3 rotation;
+  rotation = AngleAxis3D(theta, axis);
+  return rotation;
+}
+
+//Child before siblings, like a recursive traversal, without the recursion
+void Skeleton::computeTraversalOrder()
+{
+  m_TraversalOrder.clear();
+  m_Parent.assign(MAX_BONES_IN_ASF_FILE, -1);
+  m_Alignment.assign(MAX_BONES_IN_ASF_FILE, Matrix3::Identity());
+
+  std::vector<Bone *> pending;
+  pending.push_back(m_pRootBone);
+  while (!pending.empty())
+  {
+    Bone * bone = pending.back();
+    pending.pop_back();
+    m_TraversalOrder.push_back(bone->idx);
+    if (bone->idx != getRootIndex())
+      m_Alignment[bone->idx] = alignToBone(*bone);
+
+    if (bone->sibling != NULL)
+    {
+      m_Parent[bone->sibling->idx] = m_Parent[bone->idx];
+      pending.push_back(bone->sibling);
+    }
+    if (bone->child != NULL)
+    {
+      m_Parent[bone->child->idx] = bone->idx;
+      pending.push_back(bone->child);
+    }
+  }
 }
 
 Skeleton::~Skeleton()
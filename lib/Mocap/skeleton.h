@@ -14,6 +14,7 @@ Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 
 #include "posture.h"
 #include "SETTINGS.hpp"
+#include <vector>
 
 // this structure defines the property of each bone segment, including its connection to other bones,
 // DOF (degrees of freedom), relative orientation and distance to the outboard bone
@@ -68,7 +69,9 @@ public:
   static int getRootIndex() { return 0; }
 
   //Set the skeleton's pose based on the given posture
-  void setPosture(Posture posture);
+  void setPosture(const Posture & posture);
+  //Same, straight from a motion's channels. Only DOFs the bones have are set.
+  void setPosture(const PostureView & posture);
 
   //Initial posture Root at (0,0,0)
   //All bone rotations are set to 0
@@ -94,6 +97,13 @@ public:
 
   Bone& getBone(const int x) { return m_pBoneList[x]; };
 
+  // Bone indices with every parent before its children, in the order the
+  // hierarchy is traversed, and each bone's parent (-1 for the root)
+  const std::vector<int>& getTraversalOrder() { return m_TraversalOrder; }
+  int getParent(int idx) { return m_Parent[idx]; }
+  // Rotation taking the z axis onto the bone's direction
+  const Matrix3& getAlignment(int idx) { return m_Alignment[idx]; }
+
 protected:
 
   //parse the skeleton (.ASF) file
@@ -129,6 +139,11 @@ protected:
   Bone *m_pRootBone;  // Pointer to the root bone, m_RootBone = &bone[0]
   Bone  m_pBoneList[MAX_BONES_IN_ASF_FILE];   // Array with all skeleton bones
 
+  std::vector<int> m_TraversalOrder;
+  std::vector<int> m_Parent;
+  std::vector<Matrix3> m_Alignment;
+  void computeTraversalOrder();
+
   void removeCR(char * str); // removes CR at the end of line
 };
 
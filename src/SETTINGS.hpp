@@ -6,14 +6,37 @@
 #include "Eigen/Geometry"
 #include <limits.h>
 
-#define Real double
+// Build with -DRT_SINGLE_PRECISION (make float) for a single precision
+// renderer. Mocap data stays in double either way.
+#ifdef RT_SINGLE_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
 #define REAL_MAX numeric_limits<Real>::max()
 #define REAL_MIN numeric_limits<Real>::min()
 
 #define SUN_DISTANCE 100000
 
-#define RAY_T_MIN 0.0001
-#define SURFACE_EPS 0.0001
+// Rough size of the scene in world units. Offsets below scale with it, so
+// override it for scenes modelled much larger or smaller than ~10 units.
+#ifndef SCENE_SCALE
+#define SCENE_SCALE 1.0
+#endif
+
+// Floats only carry ~7 digits, so offsets that keep rays from hitting the
+// surface they left have to be larger than with doubles
+#ifdef RT_SINGLE_PRECISION
+#define RAY_T_MIN ((Real) (0.001 * SCENE_SCALE))
+#define SURFACE_EPS ((Real) (0.001 * SCENE_SCALE))
+#else
+#define RAY_T_MIN ((Real) (0.0001 * SCENE_SCALE))
+#define SURFACE_EPS ((Real) (0.0001 * SCENE_SCALE))
+#endif
+
+// Secondary rays that could add less than this to a pixel aren't traced
+#define MIN_RAY_CONTRIBUTION 0.002
 
 #define DEBUGBOOL true
 
@@ -38,8 +61,10 @@ typedef Eigen::Matrix<Real, 4, 1 > Vec4;
 typedef Vec3 Point;
 typedef Vec3 Vector;
 typedef Eigen::Transform<Real, 3, Eigen::Affine> Transform3D;
+typedef Eigen::Transform<Real, 3, Eigen::AffineCompact> Affine3D; // Stored as 3x4
 typedef Eigen::Translation<Real, 3> Translation3D;
 typedef Eigen::AngleAxis<Real> AngleAxis3D;
+typedef Eigen::Quaternion<Real> Quaternion3D;
 
 typedef Eigen::Matrix<Real, 4, 1 > Vec4;
 typedef Eigen::Matrix<int, 3, 1 > Vec3I;
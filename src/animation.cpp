@@ -2,142 +2,156 @@
 #include "shape.hpp"
 #include "image.hpp"
 #include "raytracer.hpp"
+#include "pathtracer.hpp"
+#include "light.hpp"
 #include <cstddef>
+#include <functional>
+#include <unistd.h>
 
 
-// ====================== Keyframe =========================
-template <typename T>
-bool Keyframe<T>::operator <(const Keyframe& other) const {
-    return frame < other.frame;
-}
+// ====================== KeyframeTrack =========================
 
-// ====================== KeyframeSet =========================
-template <typename T>
-const Keyframe<T>* KeyframeSet<T>::getAdjacentForFrame(int frame, bool previous) {
-    // Create a dummy keyframe for searching
-    Keyframe<T> search(frame);
-
-    typename set<Keyframe<T>>::iterator it = keyframes.find(search);
-    typename set<Keyframe<T>>::iterator before, after;
-
-    if (it != keyframes.end()) {                        // We have a keyframe for this frame.
-
-        if (next(it) != keyframes.end()) {              // If it's not at the end we use (this, next)
-            before = it;
-            after = next(it);
-            return previous? &(*before) : &(*after);
-        } else if (it != keyframes.begin()) {           // If it's not at the beginning we use (prev, this)
-            before = prev(it);
-            after = it;
-            return previous? &(*before) : &(*after);
-        } else {                                        // Otherwise it's the only keyframe. We use (this, 0)
-            before = it;
-            return previous? &(*before) : nullptr;
-        }
+bool KeyframeTrack::locate(const int* times, int count, int frame, int& cursor, int& before, int& after) {
+    if (count == 0) return false;
+
+    if (frame <= times[0]) {
+        before = after = 0;
+    } else if (frame >= times[count - 1]) {
+        before = after = count - 1;
     } else {
-        // We need to insert a keyframe to grab the pivot index
-        keyframes.insert(search);
-        it = keyframes.find(search);
-
-        if (next(it) != keyframes.end() && it != keyframes.begin()) {
-            before = prev(it);
-            after = next(it);
-            keyframes.erase(it);
-            return previous? &(*before) : &(*after);    // If it's not the end and not the beginning, use (prev, next)
-        } else if (next(it) == keyframes.end() && it == keyframes.begin()) {
-            keyframes.erase(it);
-            return nullptr;                             // If it's the end *and* the beginning, we don't have any keyframes
-        } else if (next(it) != keyframes.end()) {
-            before = next(it);
-            keyframes.erase(it);
-            return previous? nullptr : &(*before);          // If it's the beginning, return the next as the initial KF.
-        } else if (it != keyframes.begin()) {
-            before = prev(it);
-            keyframes.erase(it);
-            return previous? &(*before) : nullptr;
+        // Same segment as last time, or the next one, before searching
+        if (cursor < 0 || cursor >= count - 1 || frame < times[cursor] || frame >= times[cursor + 1]) {
+            if (cursor >= 0 && cursor < count - 2 && frame >= times[cursor + 1] && frame < times[cursor + 2]) {
+                cursor++;
+            } else {
+                cursor = upper_bound(times, times + count, frame) - times - 1;
+            }
         }
-
+        before = cursor;
+        after = cursor + 1;
     }
 
-    assert(0);
-    return 0; // Silence, clangd!
+    return true;
+}
+
+bool KeyframeTrack::setFrame(int frame) {
+    int before, after;
+    if (!locate(times.data(), times.size(), frame, cursor, before, after)) return false;
 
+    Real factor = (before == after)? 0 : interpolationFunction(times[before], times[after], frame);
+    return applySample(before, after, factor);
 }
 
-template class KeyframeSet<int>;
-template class KeyframeSet<Real>;
-template class KeyframeSet<Vector>;
+bool KeyframeTrack::sample(int frame, int& before, int& after, Real& factor) const {
+    int cursor = 0;
+    if (!locate(times.data(), times.size(), frame, cursor, before, after)) return false;
 
-template <typename T>
-const Keyframe<T>* KeyframeSet<T>::getKeyframeBefore(int frame){
-    return getAdjacentForFrame(frame, true);
+    factor = (before == after)? 0 : interpolationFunction(times[before], times[after], frame);
+    return true;
 }
 
+// ====================== KeyframeSet =========================
+
 template <typename T>
-const Keyframe<T>* KeyframeSet<T>::getKeyframeAfter(int frame){
-    return getAdjacentForFrame(frame, false);
+bool KeyframeSet<T>::applySample(int before, int after, Real factor) {
+    return updateValue(values[before], values[after], factor);
 }
 
 template <typename T>
-void KeyframeSet<T>::setFrame(int frame) {
-
-    const Keyframe<T>* before = getKeyframeBefore(frame);
-    const Keyframe<T>* after = getKeyframeAfter(frame);
-
-    if (!before && !after) return; // No keyframes present.
-
-    if (!before) {
-        updateValue(*after, *after, 0); // First keyframe
-    } else if (!after) {
-        updateValue(*before, *before, 0); // Last keyframe
-    } else {
-        Real factor = interpolationFunction(before->frame, after->frame, frame);
-        updateValue(*before, *after, factor);
-    }
+T KeyframeSet<T>::valueAt(int frame) const {
+    int before, after;
+    Real factor;
+    if (!sample(frame, before, after, factor)) return T();
+    return (values[before] * (1 - factor)) + (values[after] * factor);
 }
 
 template <typename T>
 void KeyframeSet<T>::addKeyframe(Keyframe<T> keyframe) {
-    keyframes.erase(keyframe);
-    keyframes.insert(keyframe);
+    addKeyframe(keyframe.frame, keyframe.value);
 }
 
 template <typename T>
 void KeyframeSet<T>::addKeyframe(int frame, T value) {
-    Keyframe<T> key(frame, value);
-    keyframes.erase(key);
-    keyframes.insert(key);
+    vector<int>::iterator it = lower_bound(times.begin(), times.end(), frame);
+    int index = it - times.begin();
+
+    if (it != times.end() && *it == frame) {
+        values[index] = value;
+    } else {
+        times.insert(it, frame);
+        values.insert(values.begin() + index, value);
+    }
+    revision++;
 }
 
+template class KeyframeSet<int>;
+template class KeyframeSet<Real>;
+template class KeyframeSet<Vector>;
+template class KeyframeSet<bool>;
+
 // ====================== Translator =========================
 
-void Translator::updateValue(Keyframe<Point> before, Keyframe<Point> after, Real factor) {
-    Point pos = (before.value * (1 - factor)) + (after.value * factor);
+bool Translator::updateValue(const Point& before, const Point& after, Real factor) {
+    Point pos = (before * (1 - factor)) + (after * factor);
+    if (pos == currentPosition) return false;
+
     target->translate(pos - currentPosition);
     currentPosition = pos;
+    return true;
+}
+
+bool Translator::getMotion(int frame, Affine3D& motion) const {
+    if (times.empty()) return false;
+    motion = Translation3D(valueAt(frame + 1) - valueAt(frame));
+    return true;
 }
 
 // ====================== Rotator =========================
 
-void Rotator::updateValue(Keyframe<Real> before, Keyframe<Real> after, Real factor) {
-    Real angle = (before.value * (1 - factor)) + (after.value * factor);
+bool Rotator::updateValue(const Real& before, const Real& after, Real factor) {
+    Real angle = (before * (1 - factor)) + (after * factor);
+    if (angle == currentAngle) return false;
+
     target->rotate(axis, angle - currentAngle);
     currentAngle = angle;
+    return true;
+}
+
+bool Rotator::getMotion(int frame, Affine3D& motion) const {
+    if (times.empty()) return false;
+    const Point& center = target->origin;
+    motion = Translation3D(center) * AngleAxis3D(valueAt(frame + 1) - valueAt(frame), axis.normalized()) * Translation3D(-center);
+    return true;
 }
 
 // ====================== TurnTable =========================
 
-void TurnTable::updateValue(Keyframe<Real> before, Keyframe<Real> after, Real factor) {
-    Real angle = (before.value * (1 - factor)) + (after.value * factor);
+bool TurnTable::updateValue(const Real& before, const Real& after, Real factor) {
+    Real angle = (before * (1 - factor)) + (after * factor);
+    if (angle == currentAngle) return false;
+
     target->rotate(origin, axis, angle - currentAngle);
     currentAngle = angle;
+    return true;
+}
+
+bool TurnTable::getMotion(int frame, Affine3D& motion) const {
+    if (times.empty()) return false;
+    motion = Translation3D(origin) * AngleAxis3D(valueAt(frame + 1) - valueAt(frame), axis.normalized()) * Translation3D(-origin);
+    return true;
 }
 
 // ====================== ValueAnimator =========================
 template <typename T>
-void ValueAnimator<T>::updateValue(Keyframe<T> before, Keyframe<T> after, Real factor) {
-    *target = (before.value * (1 - factor)) + (after.value * factor);
+bool ValueAnimator<T>::updateValue(const T& before, const T& after, Real factor) {
+    T value = (before * (1 - factor)) + (after * factor);
+    // Holds between equal keyframes leave the target (and its owner) alone
+    if (applied && value == *target) return false;
+
+    *target = value;
+    applied = true;
     if (owner != nullptr) owner->update();
+    return true;
 }
 
 template class ValueAnimator<int>;
@@ -146,53 +160,210 @@ template class ValueAnimator<Vector>;
 
 
 // ====================== VisibleAnimator =========================
-void VisibleAnimator::updateValue(Keyframe<bool> before, Keyframe<bool> after, Real factor) {
-    bool shouldBePresent = before.value;
+bool VisibleAnimator::updateValue(const bool& before, const bool& after, Real factor) {
+    bool shouldBePresent = before;
     bool isPresent = group->contains(shape);
     if (shouldBePresent and not isPresent) group->addShape(shape);
     if (isPresent and not shouldBePresent) group->removeShape(shape);
+    return shouldBePresent != isPresent;
 }
 
 // ====================== PinAnimation =========================
 template <typename T>
-void PinAnimation<T>::setFrame(int frame) {
-    if (frame >= startFrame && frame <= stopFrame) {
-        *target = *source;
-        if( owner != nullptr ) owner->update();
-    }
+bool PinAnimation<T>::setFrame(int frame) {
+    if (frame < startFrame || frame > stopFrame) return false;
+
+    bool moved = *target != *source;
+    *target = *source;
+    // Other animations may have moved the owner while the target held still
+    // (e.g. a camera translating while pinned to a still point), so it's
+    // updated anyway. Whatever moved it reports that change itself.
+    if( owner != nullptr ) owner->update();
+    return moved;
 }
 template class PinAnimation<int>;
 template class PinAnimation<Real>;
 template class PinAnimation<Vector>;
+// ====================== Timeline =========================
+
+void Timeline::compile(const vector<Animation*>& animations) {
+    channels.clear();
+    times.clear();
+    channelOf.assign(animations.size(), -1);
+
+    for (size_t i = 0; i < animations.size(); ++i) {
+        KeyframeTrack *track = dynamic_cast<KeyframeTrack*>(animations[i]);
+        if (track == NULL) continue;
+
+        Channel c;
+        c.track = track;
+        c.offset = times.size();
+        c.count = track->getTimes().size();
+        c.revision = track->revision;
+        c.cursor = 0;
+        c.before = c.after = -1;
+        c.factor = 0;
+
+        times.insert(times.end(), track->getTimes().begin(), track->getTimes().end());
+        channelOf[i] = channels.size();
+        channels.push_back(c);
+    }
+}
+
+bool Timeline::isStale(const vector<Animation*>& animations) const {
+    if (channelOf.size() != animations.size()) return true;
+
+    for (size_t c = 0; c < channels.size(); ++c) {
+        if (channels[c].revision != channels[c].track->revision) return true;
+    }
+    return false;
+}
+
+void Timeline::evaluate(const vector<Animation*>& animations, int frame, set<Animation*>& changed) {
+    for (size_t x = 0; x < channels.size(); ++x) {
+        Channel& c = channels[x];
+        const int *t = times.data() + c.offset;
+
+        if (!KeyframeTrack::locate(t, c.count, frame, c.cursor, c.before, c.after)) {
+            c.before = -1;
+            continue;
+        }
+        c.factor = (c.before == c.after)? 0 : c.track->interpolationFunction(t[c.before], t[c.after], frame);
+    }
+
+    for (size_t i = 0; i < animations.size(); ++i) {
+        int x = channelOf[i];
+        bool animated;
+        if (x < 0) {
+            animated = animations[i]->setFrame(frame);
+        } else {
+            const Channel& c = channels[x];
+            animated = c.before >= 0 && c.track->applySample(c.before, c.after, c.factor);
+        }
+        if (animated) changed.insert(animations[i]);
+    }
+}
+
 // =================== Animation =========================
 
+// Owners are updated in ways bounding boxes may not show, like limbs
+// moving within a skeleton's bounds
+void Animator::dependOnOwner(Animation* anim, const Shape* registered) {
+    const Shape* owner = dynamic_cast<const Shape*>(anim->getOwner());
+    if (owner != nullptr && owner != registered) shapeDependencies.push_back(make_pair(anim, owner));
+}
+
 void Animator::addAnimation(Animation* anim) {
     animations.push_back(anim);
+    dependOnOwner(anim, nullptr);
+}
+
+void Animator::addAnimation(Animation* anim, const Shape* changes) {
+    animations.push_back(anim);
+    shapeDependencies.push_back(make_pair(anim, changes));
+    dependOnOwner(anim, changes);
 }
-void Animator::setFrame(int frameNum) {
-    for (int i = 0; i < animations.size(); ++i) {
-        animations[i]->setFrame(frameNum);
+
+void Animator::addAnimation(Animation* anim, const Material* changes) {
+    animations.push_back(anim);
+    materialDependencies.push_back(make_pair(anim, changes));
+    dependOnOwner(anim, nullptr);
+}
+bool Animator::setFrame(int frameNum) {
+    if (timeline.isStale(animations)) timeline.compile(animations);
+
+    changed.clear();
+    timeline.evaluate(animations, frameNum, changed);
+    return !changed.empty();
+}
+
+template <typename T>
+static void hashCombine(size_t& seed, const T& value) {
+    seed ^= hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t Animator::hashFrame(const Camera* camera, const Scene* scene) {
+    size_t seed = 0;
+
+    vector<Real> view = camera->getViewState();
+    for (size_t x = 0; x < view.size(); ++x) hashCombine(seed, view[x]);
+
+    // Only values, no addresses, so the hash is the same from run to run
+    const vector<Shape*>& shapes = scene->shapes.members;
+    hashCombine(seed, shapes.size());
+    for (size_t x = 0; x < shapes.size(); ++x) {
+        AABB bounds = shapes[x]->getBoundingBox();
+        for (int a = 0; a < 3; ++a) {
+            hashCombine(seed, bounds.min()[a]);
+            hashCombine(seed, bounds.max()[a]);
+        }
+    }
+
+    const vector<Light*>& lights = scene->lights.members;
+    hashCombine(seed, lights.size());
+    for (size_t x = 0; x < lights.size(); ++x) {
+        if (lights[x]->isLocal()) {
+            for (int a = 0; a < 3; ++a) hashCombine(seed, lights[x]->getCenter()[a]);
+        }
+        hashCombine(seed, lights[x]->getPower());
     }
+
+    return seed;
 }
 
 void Animator::render(Camera *camera, Scene* scene, string path, int width, int height, int startFrame, int stopFrame, int step) {
     Image img(width, height);
     Image depthMap(width, height);
 
+    size_t lastHash = 0;
+    string lastFrame;
+
     for(int f = startFrame; f <= stopFrame; f += step) {
         if (stopFrame - startFrame > 1)
             fprintf(stderr, "\rRendering frame %d (%.2f%%)", f, (float) (f - startFrame) * 100 / (stopFrame - startFrame));
 
-        setFrame(f);
+        bool animated = setFrame(f);
         scene->shapes.updateBoundingBox();
-        if (startFrame == stopFrame) {
-            RayTracer::rayTrace(img, depthMap, camera, scene, true);
-        } else {
-            RayTracer::rayTrace(img, depthMap, camera, scene);
-        }
+        scene->lights.update();
 
         char i_buffer[256];
         sprintf(i_buffer, "%s/frame.%04i.ppm", path.c_str(), f);
+        // An old file here may be a link to another frame, so don't write through it
+        unlink(i_buffer);
+
+        // Nothing moved since the last frame, so it would come out the same.
+        // Cameras that can't report their view always render.
+        size_t hash = hashFrame(camera, scene);
+        if (f != startFrame && !animated && hash == lastHash && !camera->getViewState().empty()) {
+            if (link(lastFrame.c_str(), i_buffer) != 0) img.savePPM(i_buffer);
+            continue;
+        }
+        lastHash = hash;
+        lastFrame = i_buffer;
+
+        // Seed from the scene state rather than the frame number, so the
+        // same state always renders with the same samples
+        srand(hash);
+
+        if (scene->irradiance != NULL) scene->irradiance->update(scene);
+        bool status = (startFrame == stopFrame);
+        if (pathTrace) {
+            PathTracer::pathTrace(img, depthMap, camera, scene, status);
+        } else {
+            if (scene->temporal != NULL) {
+                // Only what animations changed this frame
+                vector<const Shape*> shapes;
+                vector<const Material*> materials;
+                for (size_t x = 0; x < shapeDependencies.size(); ++x) {
+                    if (changed.count(shapeDependencies[x].first)) shapes.push_back(shapeDependencies[x].second);
+                }
+                for (size_t x = 0; x < materialDependencies.size(); ++x) {
+                    if (changed.count(materialDependencies[x].first)) materials.push_back(materialDependencies[x].second);
+                }
+                scene->temporal->update(scene, camera, width, height, shapes, materials);
+            }
+            RayTracer::rayTrace(img, depthMap, camera, scene, status);
+        }
 
         camera->processDepthMap(img, depthMap);
         img.savePPM(i_buffer);
@@ -5,12 +5,14 @@
 #include "rtmath.hpp"
 #include <algorithm>
 #include <set>
+#include <vector>
 #include <iostream>
 
 class Shape;
 class ShapeGroup;
 class Scene;
 class Camera;
+class Material;
 
 using namespace std;
 
@@ -23,12 +25,10 @@ template <typename T>
 class Keyframe {
 public:
     int frame;
-    mutable T value;
+    T value;
     Keyframe(int frame): frame(frame) {}
     Keyframe(int frame, T value): frame(frame), value(value) {}
 
-    bool operator <(const Keyframe& other) const;
-
     static Real lerp(int startFrame, int endFrame, int frame) {
         if (frame < startFrame) return 0;
         if (frame > endFrame) return 1;
@@ -39,23 +39,54 @@ public:
 
 class Animation {
 public:
-    virtual void setFrame(int frame) = 0;
+    // Returns whether anything actually changed
+    virtual bool setFrame(int frame) = 0;
+    // How the shape this moves gets from frame to the next, for motion
+    // blur. Returns false if it doesn't move a shape rigidly.
+    virtual bool getMotion(int frame, Affine3D& motion) const { return false; }
+    // What gets updated after this changes something, if anything
+    virtual Animatable* getOwner() const { return nullptr; }
+};
+
+// The part of a keyframed animation that doesn't depend on the value type:
+// its keyframe times, sorted, and which two keyframes a frame falls between.
+// Values live alongside in KeyframeSet, at the same indices.
+class KeyframeTrack: public Animation {
+protected:
+    vector<int> times;
+    int cursor; // Segment found last, tried first since playback is mostly sequential
+public:
+    int revision; // Bumped whenever keyframes change, see Timeline
+    Real (*interpolationFunction)(int, int, int) = &InterpolationFunctions::smoothstep;
+
+    KeyframeTrack(): cursor(0), revision(0) {}
+    const vector<int>& getTimes() const { return times; }
+
+    // Indices of the keyframes to blend for frame, both the same outside
+    // the keyframed range. Returns false if there are no keyframes.
+    static bool locate(const int* times, int count, int frame, int& cursor, int& before, int& after);
+
+    virtual bool setFrame(int frame);
+    // What setFrame would blend, without applying it. Returns false if
+    // there are no keyframes.
+    bool sample(int frame, int& before, int& after, Real& factor) const;
+    // Set the target from the keyframes at two indices. Returns whether the target changed.
+    virtual bool applySample(int before, int after, Real factor) = 0;
 };
 
 template <typename T>
-class KeyframeSet: public Animation {
-private:
-    const Keyframe<T>* getAdjacentForFrame(int frame, bool previous);
+class KeyframeSet: public KeyframeTrack {
+protected:
+    vector<T> values;
 public:
-    virtual void setFrame(int frame);
     virtual void addKeyframe(Keyframe<T> keyframe);
     virtual void addKeyframe(int frame, T value);
-    virtual void updateValue(Keyframe<T> before, Keyframe<T> after, Real factor) = 0;
-    Real (*interpolationFunction)(int, int, int) = &InterpolationFunctions::smoothstep;
-protected:
-    set<Keyframe<T>> keyframes;
-    virtual const Keyframe<T>* getKeyframeBefore(int frame);
-    virtual const Keyframe<T>* getKeyframeAfter(int frame);
+    virtual bool applySample(int before, int after, Real factor);
+    // Returns whether the target changed
+    virtual bool updateValue(const T& before, const T& after, Real factor) = 0;
+    // What setFrame(frame) would set the target to, without setting it.
+    // Needs at least one keyframe.
+    T valueAt(int frame) const;
 };
 
 class Translator: public KeyframeSet<Point> {
@@ -64,7 +95,8 @@ private:
     Point currentPosition;
 public:
     Translator(Shape* target, Point currentPosition): target(target), currentPosition(currentPosition) {};
-    virtual void updateValue(Keyframe<Point> before, Keyframe<Point> after, Real factor);
+    virtual bool updateValue(const Point& before, const Point& after, Real factor);
+    virtual bool getMotion(int frame, Affine3D& motion) const;
 };
 
 class Rotator: public KeyframeSet<Real> {
@@ -74,7 +106,8 @@ private:
     Real currentAngle;
 public:
     Rotator(Shape* target, Vector axis, Real currentAngle): target(target), axis(axis), currentAngle(currentAngle) {};
-    virtual void updateValue(Keyframe<Real> before, Keyframe<Real> after, Real factor);
+    virtual bool updateValue(const Real& before, const Real& after, Real factor);
+    virtual bool getMotion(int frame, Affine3D& motion) const;
 };
 
 
@@ -86,7 +119,8 @@ private:
     Real currentAngle;
 public:
     TurnTable(Shape* target, Point origin, Vector axis, Real currentAngle): target(target), origin(origin), axis(axis), currentAngle(currentAngle) {};
-    virtual void updateValue(Keyframe<Real> before, Keyframe<Real> after, Real factor);
+    virtual bool updateValue(const Real& before, const Real& after, Real factor);
+    virtual bool getMotion(int frame, Affine3D& motion) const;
 };
 
 template <typename T>
@@ -94,10 +128,12 @@ class ValueAnimator: public KeyframeSet<T> {
 private:
     T* target;
     Animatable *owner;
+    bool applied; // Whether the target has been set once
 public:
-    ValueAnimator(T* target, Animatable *owner): target(target), owner(owner) {};
-    ValueAnimator(T* target): target(target), owner(nullptr) {};
-    virtual void updateValue(Keyframe<T> before, Keyframe<T> after, Real factor);
+    ValueAnimator(T* target, Animatable *owner): target(target), owner(owner), applied(false) {};
+    ValueAnimator(T* target): target(target), owner(nullptr), applied(false) {};
+    virtual bool updateValue(const T& before, const T& after, Real factor);
+    Animatable* getOwner() const { return owner; }
 };
 
 class VisibleAnimator: public KeyframeSet<bool> {
@@ -106,7 +142,7 @@ private:
     ShapeGroup* group;
 public:
     VisibleAnimator(Shape* shape, ShapeGroup* group): shape(shape), group(group) {};
-    virtual void updateValue(Keyframe<bool> before, Keyframe<bool>, Real factor);
+    virtual bool updateValue(const bool& before, const bool& after, Real factor);
 };
 
 
@@ -124,15 +160,61 @@ public:
         : target(target), source(source), startFrame(startFrame), stopFrame(stopFrame), owner(owner) {}
     PinAnimation(T* target, T* source, int startFrame, int stopFrame)
         : target(target), source(source), startFrame(startFrame), stopFrame(stopFrame), owner(nullptr){}
-    void setFrame(int frame);
+    bool setFrame(int frame);
+    Animatable* getOwner() const { return owner; }
+};
+
+// Keyframe times of every track an Animator plays, packed into one array.
+// Each frame, all tracks find their keyframes in one pass before any of
+// them is applied.
+class Timeline {
+private:
+    struct Channel {
+        KeyframeTrack *track;
+        int offset, count; // Where its times are in the packed array
+        int revision;      // Of the track when it was packed
+        int cursor;
+        int before, after; // Last evaluated, before is -1 without keyframes
+        Real factor;
+    };
+
+    vector<Channel> channels;
+    vector<int> times;
+    vector<int> channelOf; // Each animation's channel, -1 if it isn't a track
+
+public:
+    void compile(const vector<Animation*>& animations);
+    // Whether animations or keyframes changed since compile()
+    bool isStale(const vector<Animation*>& animations) const;
+    // Set every animation to frame, in the order given, and collect the
+    // ones that changed anything
+    void evaluate(const vector<Animation*>& animations, int frame, set<Animation*>& changed);
 };
 
 class Animator {
 private:
     vector<Animation *> animations;
+    Timeline timeline;
+    // What animations change that bounding boxes don't show (see TemporalCache)
+    vector<pair<Animation*, const Shape*>> shapeDependencies;
+    vector<pair<Animation*, const Material*>> materialDependencies;
+    set<Animation*> changed; // Animations that changed something in the last setFrame
+    void dependOnOwner(Animation* anim, const Shape* registered);
 public:
+    bool pathTrace = false; // Render with PathTracer instead of RayTracer
     void addAnimation(Animation* anim);
-    void setFrame(int frameNum);
+    // For animations whose effect can't be seen from bounding boxes, like a
+    // shape turning in place or a material's texture moving. An animation's
+    // owner is taken as changed too when it's a shape (e.g. a skeleton whose
+    // pose a ValueAnimator drives), without having to be passed here.
+    void addAnimation(Animation* anim, const Shape* changes);
+    void addAnimation(Animation* anim, const Material* changes);
+    // Returns whether any animation changed anything
+    bool setFrame(int frameNum);
+    // Summary of everything a frame's render depends on that can be read
+    // back from the scene: the camera's view, shape bounds and lights.
+    // Animated materials don't show up here, only in what setFrame returns.
+    static size_t hashFrame(const Camera* camera, const Scene* scene);
     void render(Camera *camera, Scene* scene, string path, int width, int height, int startFrame, int stopFrame, int step);
 };
 
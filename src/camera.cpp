@@ -116,6 +116,19 @@ void PerspectiveCamera::rotate(const Vector& axis, const Real angle) {
     w = trans * w;
 }
 
+vector<Real> PerspectiveCamera::getViewState() const {
+    vector<Real> state;
+    const Vector* vectors[] = { &origin, &u, &v, &w };
+    for (int x = 0; x < 4; ++x) {
+        state.insert(state.end(), vectors[x]->data(), vectors[x]->data() + 3);
+    }
+
+    Real params[] = { width, height, near, apertureSize, focalLength,
+                      (Real) samplesPerPixel, (Real) rayBudget };
+    state.insert(state.end(), params, params + 7);
+    return state;
+}
+
 AABB PerspectiveCamera::getBoundingBox() const {
     return AABB(origin);
 }
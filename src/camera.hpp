@@ -16,7 +16,18 @@ public:
     }
     int samplesPerPixel = 1;
     int depthSamplesPerPixel = 1;
+    int rayBudget = 4096; // Most secondary rays one pixel may trace, 0 for no limit
+    Real shutter = 0; // Part of each frame the shutter stays open, for motion blur
+    // When in the frame a pixel's sample-th ray is taken, spreading its
+    // samples evenly over the shutter
+    Real sampleTime(int sample) const {
+        if (shutter <= 0) return 0;
+        return shutter * (sample + (Real) rand() / RAND_MAX) / samplesPerPixel;
+    }
     virtual void processDepthMap(Image& image, Image& depthMap) const {}
+    // Everything the rays made depend on, so renders can tell whether the
+    // view changed between frames. Empty if unknown.
+    virtual vector<Real> getViewState() const { return vector<Real>(); }
 };
 
 class PerspectiveCamera: public Camera, public Shape {
@@ -38,6 +49,7 @@ public:
     void rotate(const Vector& axis, const Real angle);
     AABB getBoundingBox() const;
     virtual void processDepthMap(Image& image, Image& depthMap) const;
+    vector<Real> getViewState() const;
 };
 
 
@@ -6,47 +6,42 @@
 #include "tube.hpp"
 #include "sphere.hpp"
 
+// The tube and caps live inside the capsule, so making one allocates nothing
 class Capsule: public ShapeGroup {
 private:
-    Tube* tube;
-    Sphere* startCap;
-    Sphere* endCap;
+    Tube tube;
+    Sphere startCap;
+    Sphere endCap;
 
 public:
-    Point& start = startCap->origin;
-    Point& end = endCap->origin;
-
-    Capsule(const Point& origin, const Vector& axis, Real radius, Real length, const Vector& u, Material *material) {
-        Vector axn(axis.normalized());
-
-        tube = new Tube(origin, axn, radius, length, u, material);
-
-        startCap = new Sphere(origin, u, -axn, radius, material);
-        endCap = new Sphere(origin + (axn * length), u, axn, radius, material);
-
-        addShape(tube);
-        addShape(endCap);
-        addShape(startCap);
+    Point& start = startCap.origin;
+    Point& end = endCap.origin;
+
+    Capsule(const Point& origin, const Vector& axis, Real radius, Real length, const Vector& u, Material *material):
+        tube(origin, axis.normalized(), radius, length, u, material),
+        startCap(origin, u, -axis.normalized(), radius, material),
+        endCap(origin + (axis.normalized() * length), u, axis.normalized(), radius, material)
+    {
+        addShape(&tube);
+        addShape(&endCap);
+        addShape(&startCap);
     }
 
-    Capsule(const Point& origin, const Point& end, Real radius, const Vector& u, Material *material) {
-        Vector axn = (end - origin).normalized();
-        Real length = (end - origin).dot(axn);
-
-        tube = new Tube(origin, end, radius, u, material);
-        startCap = new Sphere(origin, u, -axn, radius, material);
-        endCap = new Sphere(origin + (axn * length), u, axn, radius, material);
-
-        addShape(tube);
-        addShape(startCap);
-        addShape(endCap);
+    Capsule(const Point& origin, const Point& end, Real radius, const Vector& u, Material *material):
+        tube(origin, end, radius, u, material),
+        startCap(origin, u, -(end - origin).normalized(), radius, material),
+        endCap(end, u, (end - origin).normalized(), radius, material)
+    {
+        addShape(&tube);
+        addShape(&startCap);
+        addShape(&endCap);
     }
 
-    ~Capsule() {
-        delete tube;
-        delete startCap;
-        delete endCap;
-    }
+    ~Capsule() {};
+    // The group holds pointers to this one's parts, a copy would point back
+    // into the original
+    Capsule(const Capsule& other) = delete;
+    Capsule& operator=(const Capsule& other) = delete;
 
 };
 #endif
@@ -47,10 +47,15 @@ bool Circle::intersect(Intersection &intersection) const {
     intersection.t = t;
     intersection.intersected = true;
     intersection.shape = this;
+
+    return true;
+}
+
+void Circle::computeSurface(Intersection &intersection) const {
     intersection.normal = normal;
 
     // Flip normal if necessary
-    if (intersection.ray.dir.dot(intersection.normal) > 0) {
+    if (intersection.ray.direction.dot(intersection.normal) > 0) {
         intersection.normal *= -1;
     }
 
@@ -61,8 +66,6 @@ bool Circle::intersect(Intersection &intersection) const {
 
     intersection.tangent = u;
     intersection.bitangent = v;
-
-    return true;
 }
 
 AABB Circle::getBoundingBox() const {
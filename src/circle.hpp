@@ -16,6 +16,7 @@ public:
     ~Circle() {};
 
     bool intersect(Intersection &intersection) const;
+    void computeSurface(Intersection &intersection) const;
     using Shape::rotate;
     void translate(const Vector& t);
     void rotate(const Vector& axis, const Real angle);
@@ -51,12 +51,12 @@ public:
 
         while(tester.intersected && count <= 5) {
             // Make intersection from camera for insertion
-            tester.t = (tester.ray.at(tester.t) - i.ray.origin).dot(i.ray.dir);
+            tester.t = (tester.ray.at(tester.t) - i.ray.origin).dot(i.ray.direction);
             tester.ray = i.ray;
             insert(tester);
 
             // Move ray back to where it was, progress it a bit and intersect it
-            Ray nextRay(tester.ray.at(tester.t + 2 * SURFACE_EPS), tester.ray.dir);
+            Ray nextRay(tester.ray.at(tester.t + 2 * SURFACE_EPS), tester.ray.direction, tester.ray.time);
             tester = Intersection(nextRay);
             shape->intersect(tester);
             count++;
@@ -100,7 +100,7 @@ public:
 
     bool intersect(Intersection& i) const {
         //FIXME Account for intersection from inside, sending ray backwards and merging spans
-        if (this->getBoundingBox().contains(i.ray.o)) return false;
+        if (this->getBoundingBox().contains(i.ray.origin)) return false;
 
         if(not this->getBoundingBox().doesIntersect(i.ray)) return false;
 
@@ -117,25 +117,16 @@ public:
         if (!out.intersected) return false;
         if (i.intersected && out.t > i.t) return false;
 
-        // Copy over everything but the ray
-        // TODO Make this copying a method of Intersection class
-
-        i.intersected = out.intersected; // Always true
-
-        i.shape = out.shape;
-
-        i.normal = out.normal;
-
-        i.t = out.t;
-        i.u = out.u;
-        i.v = out.v;
-
-        i.tangent = out.tangent;
-        i.bitangent = out.bitangent;
+        i.copyHit(out);
 
         return true;
     }
 
+    // Hits are always on a or b (see CSGSpan)
+    bool resolveSurface(Intersection& i) const {
+        return a->resolveSurface(i) || b->resolveSurface(i);
+    }
+
     void setMaterial(Material* mat) {
         a->setMaterial(mat);
         b->setMaterial(mat);
@@ -8,44 +8,39 @@
 
 using namespace std;
 
+// The tube and caps live inside the cylinder, so making one allocates nothing
 class Cylinder: public ShapeGroup {
 private:
-    Tube* tube;
-    Circle* startCap;
-    Circle* endCap;
+    Tube tube;
+    Circle startCap;
+    Circle endCap;
 
 public:
-    Cylinder(const Point& origin, const Vector& axis, Real radius, Real length, const Vector& u, Material *material) {
-        Vector axn(axis.normalized());
-
-        tube = new Tube(origin, axn, radius, length, u, material);
-
-        startCap = new Circle(origin, -axn, radius, u, material);
-        endCap = new Circle(origin + (axn * length), axn, radius, u, material);
-
-        addShape(tube);
-        addShape(endCap);
-        addShape(startCap);
+    Cylinder(const Point& origin, const Vector& axis, Real radius, Real length, const Vector& u, Material *material):
+        tube(origin, axis.normalized(), radius, length, u, material),
+        startCap(origin, -axis.normalized(), radius, u, material),
+        endCap(origin + (axis.normalized() * length), axis.normalized(), radius, u, material)
+    {
+        addShape(&tube);
+        addShape(&endCap);
+        addShape(&startCap);
     }
 
-    Cylinder(const Point& origin, const Point& end, Real radius, const Vector& u, Material *material) {
-        Vector axn = (end - origin).normalized();
-        Real length = (end - origin).dot(axn);
-
-        tube = new Tube(origin, end, radius, u, material);
-        startCap = new Circle(origin, -axn, radius, u, material);
-        endCap = new Circle(origin + (axn * length), axn, radius, u, material);
-
-        addShape(tube);
-        addShape(startCap);
-        addShape(endCap);
+    Cylinder(const Point& origin, const Point& end, Real radius, const Vector& u, Material *material):
+        tube(origin, end, radius, u, material),
+        startCap(origin, -(end - origin).normalized(), radius, u, material),
+        endCap(end, (end - origin).normalized(), radius, u, material)
+    {
+        addShape(&tube);
+        addShape(&startCap);
+        addShape(&endCap);
     }
 
-    ~Cylinder() {
-        delete tube;
-        delete startCap;
-        delete endCap;
-    }
+    ~Cylinder() {};
+    // The group holds pointers to this one's parts, a copy would point back
+    // into the original
+    Cylinder(const Cylinder& other) = delete;
+    Cylinder& operator=(const Cylinder& other) = delete;
 
 };
 
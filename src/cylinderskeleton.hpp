@@ -20,96 +20,101 @@ private:
     int curFrameIdx;
     Vector axes;
     Vector origin;
-public:
-    int frameIdx; // public for animator access
 
-    CylinderSkeleton(string skeletonFilename, string motionFilename, Material* material,
-        int initialFrame = 0, Vector axes = Vector(1,1,1), Vector origin = Vector(0,0,0))
-        : material(material), axes(axes), origin(origin)
-    {
+    // Own the members
+    ShapePool<Sphere> spheres;
+    ShapePool<Tube> tubes;
+
+    void load(Skeleton* skeleton, Motion* motion, int initialFrame) {
+        this->skeleton = skeleton;
+        this->motion = motion;
+
         // DisplaySkeleton
         displayer = new DisplaySkeleton();
-
-        // Skeleton
-        skeleton = new Skeleton(skeletonFilename.c_str(), MOCAP_SCALE);
-        skeleton->setBasePosture();
         displayer->LoadSkeleton(skeleton);
-
-        // Motion
-        motion = new Motion(motionFilename.c_str(), MOCAP_SCALE, skeleton);
         displayer->LoadMotion(motion);
-        skeleton->setPosture(*(displayer->GetSkeletonMotion(0)->GetPosture(initialFrame))); // Set initial posture
+        skeleton->setPosture(motion->GetPostureView(initialFrame)); // Set initial posture
 
         curFrameIdx = frameIdx = initialFrame;
         updatePosition();
     }
 
-    void clearMembers() {
-        for (int i = 0; i < members.size(); ++i) {
-            delete members[i];
-        }
-        members.clear();
+public:
+    int frameIdx; // public for animator access
+
+    CylinderSkeleton(string skeletonFilename, string motionFilename, Material* material,
+        int initialFrame = 0, Vector axes = Vector(1,1,1), Vector origin = Vector(0,0,0))
+        : material(material), axes(axes), origin(origin)
+    {
+        Skeleton* skeleton = new Skeleton(skeletonFilename.c_str(), MOCAP_SCALE);
+        skeleton->setBasePosture();
+        load(skeleton, new Motion(motionFilename.c_str(), MOCAP_SCALE, skeleton), initialFrame);
     }
 
+    // Takes ownership of an already parsed skeleton and motion (see AssetLoader)
+    CylinderSkeleton(Skeleton* skeleton, Motion* motion, Material* material,
+        int initialFrame = 0, Vector axes = Vector(1,1,1), Vector origin = Vector(0,0,0))
+        : material(material), axes(axes), origin(origin)
+    {
+        load(skeleton, motion, initialFrame);
+    }
+
+    ~CylinderSkeleton() {};
+
     void updatePosition() {
         // Clamp frameIdx
         if (frameIdx < 0) frameIdx = 0;
         if (frameIdx >= displayer->GetSkeletonMotion(0)->GetNumFrames()) frameIdx = displayer->GetSkeletonMotion(0)->GetNumFrames() - 1;
 
+        if (!members.empty() && frameIdx == curFrameIdx) return;
+        curFrameIdx = frameIdx;
+
         // Set posture and calculate new bone positions
-        displayer->GetSkeleton(0)->setPosture(* (displayer->GetSkeletonMotion(0)->GetPosture(frameIdx)));
+        displayer->GetSkeleton(0)->setPosture(displayer->GetSkeletonMotion(0)->GetPostureView(frameIdx));
         displayer->ComputeBonePositions(DisplaySkeleton::BONES_AND_LOCAL_FRAMES);
 
-
-        // Clear existing spheres
-        clearMembers();
-
-        // Now we create spheres in the shape of the skeleton.
-        // First grab the bone parameters:
+        // Grab the bone parameters
         vector<Matrix4>& rotations = displayer->rotations();
         vector<Matrix4>& scalings = displayer->scalings();
         vector<Vec4>& translations = displayer->translations();
         vector<float>& lengths = displayer->lengths();
 
         int numBones = rotations.size();
-        // int numBones = 2; // FOR TESTING ONLY
 
-        // Now we iterate, disregarding the first bone (the origin)
+        // Two spheres and a tube per bone, disregarding the first bone (the
+        // origin). They're made once and moved into place from then on.
+        bool first = members.empty();
+
         for (int i = 1; i < numBones; ++i) {
-            Matrix4& rotation = rotations[i];
-            Matrix4& scaling = scalings[i];
+            Matrix4 transform = rotations[i] * scalings[i];
             Vec4& translation = translations[i];
 
-            Vec4 leftVertex(0,0,0,1);
-            Vec4 rightVertex(0,0,lengths[i],1);
-
-            leftVertex = rotation * scaling * leftVertex + translation;
-            rightVertex = rotation * scaling * rightVertex + translation;
-
-            // Get the direction we need to interpolate in
-            Vector direction = (rightVertex - leftVertex).head<3>();
-            const float magnitude = direction.norm();
-            direction *= 1.0 / magnitude;
+            Vec4 leftVertex = transform * Vec4(0,0,0,1) + translation;
+            Vec4 rightVertex = transform * Vec4(0,0,lengths[i],1) + translation;
 
             // Reduce dimensions after transform
-            Vector left3(leftVertex[0], leftVertex[1], leftVertex[2]);
-            Vector right3(rightVertex[0], rightVertex[1], rightVertex[2]);
-
-            left3 = left3.cwiseProduct(axes) + origin;
-            right3 = right3.cwiseProduct(axes) + origin;
-
-
-            // Draw a cylinder
-            addShape(new Sphere(left3, 0.2, material));
-            addShape(new Sphere(right3, 0.2, material));
+            Vector left3 = leftVertex.head<3>().cwiseProduct(axes) + origin;
+            Vector right3 = rightVertex.head<3>().cwiseProduct(axes) + origin;
 
             // Determine tangent direction for surface
             Vector tangent(0,0,1);
             Vector axis = (right3 - left3).normalized();
             if (tangent.dot(axis) > 0.9) tangent = Vector(0,1,0);
-            addShape(new Tube(left3, right3, 0.2, tangent, material));
 
+            if (first) {
+                members.push_back(spheres.make(left3, 0.2, material));
+                members.push_back(spheres.make(right3, 0.2, material));
+                members.push_back(tubes.make(left3, right3, 0.2, tangent, material));
+                continue;
+            }
+
+            int base = 3 * (i - 1);
+            members[base]->origin = left3;
+            members[base + 1]->origin = right3;
+            ((Tube*) members[base + 2])->setEndpoints(left3, right3, tangent);
         }
+
+        updateBoundingBox();
     }
 
     void update() override {
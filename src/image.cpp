@@ -29,7 +29,7 @@ void writePPM(const string& filename, const int& xRes, const int& yRes, float*&
     delete[] pixels;
 }
 
-void readPPM(const string& filename, int& xRes, int& yRes, float*& values) {
+void readPPM(const string& filename, int& xRes, int& yRes, unsigned char*& pixels) {
     // try to open the file
     FILE *fp;
     fp = fopen(filename.c_str(), "rb");
@@ -50,19 +50,11 @@ void readPPM(const string& filename, int& xRes, int& yRes, float*& values) {
     }
     int totalCells = xRes * yRes;
 
-    // grab the pixel values
-    unsigned char* pixels = new unsigned char[3 * totalCells];
+    // grab the pixel values, the caller converts them straight to Colors
+    pixels = new unsigned char[3 * totalCells];
     fread(pixels, 1, totalCells * 3, fp);
 
-    // copy to a nicer data type
-    values = new float[3 * totalCells];
-    for (int i = 0; i < 3 * totalCells; i++)
-        values[i] = pixels[i];
-
-    // clean up
-    delete[] pixels;
     fclose(fp);
-    cout << "Read in file " << filename.c_str() << endl;
 }
 
 Image::Image(int width, int height): width(width), height(height){
@@ -70,18 +62,18 @@ Image::Image(int width, int height): width(width), height(height){
 }
 
 Image::Image(const string& filename) {
-    float* values;
-    readPPM(filename, width, height, values);
+    unsigned char* pixels;
+    readPPM(filename, width, height, pixels);
     data = new Color[width * height];
 
     for (int i = 0, c = 0; c < width*height; i+=3, c++) {
-        Real r = (float) values[i] / 255;
-        Real g = (float) values[i+1] / 255;
-        Real b = (float) values[i+2] / 255;
+        Real r = (Real) pixels[i] / 255;
+        Real g = (Real) pixels[i+1] / 255;
+        Real b = (Real) pixels[i+2] / 255;
         data[c] = Color(r, g, b);
     }
 
-    delete[] values;
+    delete[] pixels;
 }
 
 Image::Image(const Image& other): Image(1,1) {
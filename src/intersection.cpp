@@ -2,9 +2,45 @@
 #include "shape.hpp"
 #include "scene.hpp"
 
+const RayContext RayContext::none;
+
 Intersection::Intersection(const Ray& ray):
-    shape(NULL), ray(Ray(ray)), t(0), u(0), v(0), intersected(false),
-    DEBUG(false), bouncesLeft(-1) {}
+    shape(NULL), primitive(-1), ray(Ray(ray)), t(0), u(0), v(0), intersected(false),
+    DEBUG(false), bouncesLeft(-1), context(&RayContext::none) {}
+
+bool Intersection::spawn(Intersection& child, RayContext& childContext, const Color& weight) const {
+    childContext = *context;
+    childContext.throughput = context->throughput.cwiseProduct(weight);
+    child.context = &childContext;
+    child.ray.time = ray.time;
+    if (DEBUG) child.DEBUG = true;
+
+    if (childContext.throughput.maxCoeff() < MIN_RAY_CONTRIBUTION) return false;
+
+    RayBudget *budget = context->budget;
+    if (budget != NULL) {
+        if (budget->raysLeft <= 0) return false;
+        budget->raysLeft--;
+    }
+
+    return true;
+}
+
+void Intersection::copyHit(const Intersection& other) {
+    intersected = other.intersected;
+
+    shape = other.shape;
+    primitive = other.primitive;
+
+    normal = other.normal;
+
+    t = other.t;
+    u = other.u;
+    v = other.v;
+
+    tangent = other.tangent;
+    bitangent = other.bitangent;
+}
 
 
 Color Intersection::getColor(const Scene *scene) const{
@@ -21,5 +57,5 @@ Point Intersection::getPosition() const {
 
 void Intersection::print() {
         printf("Intersection %d at t=%f with shape %p (root=(%.2f, %.2f, %.2f), dir=(%.2f, %.2f, %.2f))\n",
-            intersected, t, shape, ray.o[0], ray.o[1], ray.o[2], ray.dir[0], ray.dir[1], ray.dir[2]);
+            intersected, t, shape, ray.origin[0], ray.origin[1], ray.origin[2], ray.direction[0], ray.direction[1], ray.direction[2]);
 }
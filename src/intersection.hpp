@@ -8,10 +8,38 @@
 // Forward declare Shape class
 class Shape;
 class Scene;
+struct PixelDeps;
 
+// Secondary rays a pixel may still trace, shared by every ray it spawns
+struct RayBudget {
+    int raysLeft;
+};
+
+// What a ray carries along its path besides the hit itself. Each ray that
+// spawns others hands them a context of their own (see Intersection::spawn).
+struct RayContext {
+    // Most the ray's color can still add to its pixel, and the pixel's
+    // remaining rays (NULL for no limit)
+    Color throughput;
+    RayBudget *budget;
+
+    bool indirect; // Whether diffuse surfaces hit may add cached indirect light
+
+    PixelDeps *deps; // Where to record what this ray touches, NULL if unused
+
+    RayContext(): throughput(1,1,1), budget(NULL), indirect(true), deps(NULL) {}
+
+    // For rays that weren't given one
+    static const RayContext none;
+};
+
+// Filled in two phases: intersect() only records t and what was hit, the
+// surface attributes below are computed once for the final hit (see
+// Shape::resolveSurface).
 class Intersection {
 public:
     const Shape *shape;
+    int primitive; // Which part of shape was hit, for shapes made of several
     Ray ray;
     Real t;
 
@@ -26,9 +54,19 @@ public:
 
     int bouncesLeft;
 
+    const RayContext *context; // State of the path this ray is on, not part of the hit
+
 
     Intersection(const Ray& ray);
 
+    // Set up a secondary ray whose color will be scaled by weight, filling
+    // in context for it. Returns false if it isn't worth tracing or the
+    // pixel is out of rays.
+    bool spawn(Intersection& child, RayContext& childContext, const Color& weight) const;
+
+    // Copy everything but the ray from another intersection
+    void copyHit(const Intersection& other);
+
     Point getPosition() const;
 
     Color getColor(const Scene *scene) const;
@@ -0,0 +1,232 @@
+#include "irradiancecache.hpp"
+#include "scene.hpp"
+#include "light.hpp"
+
+#define IRRADIANCE_MAX_DEPTH 16
+
+// ==================== Node ======================
+
+IrradianceCache::Node::Node(const Point& center, Real halfSize): center(center), halfSize(halfSize) {
+    for (int c = 0; c < 8; ++c) children[c] = NULL;
+}
+
+IrradianceCache::Node::~Node() {
+    for (int c = 0; c < 8; ++c) delete children[c];
+}
+
+// ==================== IrradianceCache ======================
+
+IrradianceCache::IrradianceCache(const AABB& bounds, Real tolerance, int numSamples)
+    : tolerance(tolerance), numSamples(numSamples)
+{
+    Real size = (bounds.max() - bounds.min()).maxCoeff();
+    root = new Node(bounds.center(), size / 2);
+
+    minSpacing = size * 0.002;
+    maxSpacing = size * 0.1;
+}
+
+IrradianceCache::~IrradianceCache() {
+    delete root;
+}
+
+void IrradianceCache::clear() {
+    Point center = root->center;
+    Real halfSize = root->halfSize;
+    delete root;
+    root = new Node(center, halfSize);
+}
+
+// Ward's weight: inverse of the estimated error of reusing r at p
+Real IrradianceCache::weight(const Record& r, const Point& p, const Vector& n) const {
+    // Records in front of p see a different neighbourhood
+    Real front = (p - r.position).dot((n + r.normal) / 2);
+    if (front < -0.01 * r.radius) return 0;
+
+    Real error = (p - r.position).norm() / r.radius + sqrt(std::max((Real) 0, 1 - n.dot(r.normal)));
+    if (error <= 0) return REAL_MAX;
+    return 1 / error;
+}
+
+void IrradianceCache::lookup(const Node* node, const Point& p, const Vector& n, Color& sum, Real& totalWeight) const {
+    for (size_t x = 0; x < node->records.size(); ++x) {
+        Real w = weight(node->records[x], p, n);
+        if (w > 1 / tolerance) {
+            if (w == REAL_MAX) w = 1e10;
+            sum += w * node->records[x].irradiance;
+            totalWeight += w;
+        }
+    }
+
+    for (int c = 0; c < 8; ++c) {
+        const Node *child = node->children[c];
+        if (child == NULL) continue;
+
+        // Loose bounds: records reach up to one half size past the node
+        Real reach = 2 * child->halfSize;
+        if ((p - child->center).cwiseAbs().maxCoeff() <= reach) {
+            lookup(child, p, n, sum, totalWeight);
+        }
+    }
+}
+
+void IrradianceCache::insert(const Record& r) {
+    Real validRadius = tolerance * r.radius;
+    Node *node = root;
+
+    // Points outside the root stay in it, which is always searched
+    if ((r.position - root->center).cwiseAbs().maxCoeff() > root->halfSize) {
+        root->records.push_back(r);
+        return;
+    }
+
+    for (int depth = 0; depth < IRRADIANCE_MAX_DEPTH && node->halfSize / 2 >= validRadius; ++depth) {
+        int c = 0;
+        Vector offset(0,0,0);
+        for (int axis = 0; axis < 3; ++axis) {
+            bool upper = r.position[axis] >= node->center[axis];
+            if (upper) c |= (1 << axis);
+            offset[axis] = upper? 1 : -1;
+        }
+
+        if (node->children[c] == NULL) {
+            Real half = node->halfSize / 2;
+            node->children[c] = new Node(node->center + offset * half, half);
+        }
+        node = node->children[c];
+    }
+
+    node->records.push_back(r);
+}
+
+IrradianceCache::Record IrradianceCache::gather(const Point& p, const Vector& n, const Scene* scene) const {
+    Vector helper = (fabs(n.x()) > 0.9)? Vector(0,1,0) : Vector(1,0,0);
+    Vector t = n.cross(helper).normalized();
+    Vector b = n.cross(t);
+
+    // Stratified, cosine weighted hemisphere, so the plain average of the
+    // samples is the irradiance
+    int strataU = std::max(1, (int) sqrt((Real) numSamples));
+    int strataV = std::max(1, numSamples / strataU);
+
+    Color sum(0,0,0);
+    Real inverseDistances = 0;
+    int count = 0;
+
+    for (int su = 0; su < strataU; ++su) {
+        for (int sv = 0; sv < strataV; ++sv) {
+            Real u = (su + (Real) rand() / RAND_MAX) / strataU;
+            Real v = (sv + (Real) rand() / RAND_MAX) / strataV;
+            Real r = sqrt(u);
+            Real phi = 2 * M_PI * v;
+
+            Vector dir = (r * cos(phi)) * t + (r * sin(phi)) * b + sqrt(std::max((Real) 0, 1 - u)) * n;
+
+            // One bounce only: the surfaces seen don't gather indirect light
+            // themselves, and mirrors and glass seen from here are skipped
+            RayContext gather;
+            gather.indirect = false;
+            Intersection sample(Ray(p, dir));
+            sample.bouncesLeft = 0;
+            sample.context = &gather;
+            scene->intersect(sample);
+
+            sum += sample.getColor(scene);
+            if (sample.intersected) inverseDistances += 1 / std::max(sample.t, (Real) SURFACE_EPS);
+            count++;
+        }
+    }
+
+    Record rec;
+    rec.position = p;
+    rec.normal = n;
+    rec.irradiance = sum / count;
+    rec.radius = (inverseDistances > 0)? count / inverseDistances : maxSpacing;
+    rec.radius = std::min(std::max(rec.radius, minSpacing), maxSpacing);
+
+    return rec;
+}
+
+Color IrradianceCache::getIrradiance(const Intersection* i, const Scene* scene) {
+    Point p = i->getPosition();
+    Vector n = i->normal;
+    if (n.dot(i->ray.direction) > 0) n = -n;
+
+    Color sum(0,0,0);
+    Real totalWeight = 0;
+    lookup(root, p, n, sum, totalWeight);
+
+    if (totalWeight > 0) return sum / totalWeight;
+
+    Record rec = gather(p, n, scene);
+    insert(rec);
+    return rec.irradiance;
+}
+
+void IrradianceCache::invalidate(Node* node, const AABB& region) {
+    vector<Record>& records = node->records;
+    for (size_t x = 0; x < records.size();) {
+        // A record depends on the surfaces within about its radius
+        Real reach = records[x].radius;
+        if (region.squaredExteriorDistance(records[x].position) <= reach * reach) {
+            records[x] = records.back();
+            records.pop_back();
+        } else {
+            ++x;
+        }
+    }
+
+    for (int c = 0; c < 8; ++c) {
+        if (node->children[c] != NULL) invalidate(node->children[c], region);
+    }
+}
+
+void IrradianceCache::invalidate(const AABB& region) {
+    invalidate(root, region);
+}
+
+void IrradianceCache::update(const Scene* scene) {
+    // Indirect light everywhere depends on the lights
+    vector<Point> lights;
+    for (size_t x = 0; x < scene->lights.members.size(); ++x) {
+        if (scene->lights.members[x]->isLocal()) lights.push_back(scene->lights.members[x]->getCenter());
+    }
+    if (lights != lastLights) clear();
+    lastLights = lights;
+
+    map<const Shape*, AABB> bounds;
+    const vector<Shape*>& shapes = scene->shapes.members;
+    for (size_t x = 0; x < shapes.size(); ++x) {
+        bounds[shapes[x]] = shapes[x]->getBoundingBox();
+    }
+
+    // Shapes that moved, appeared or disappeared
+    for (map<const Shape*, AABB>::iterator it = bounds.begin(); it != bounds.end(); ++it) {
+        map<const Shape*, AABB>::iterator last = lastBounds.find(it->first);
+        if (last == lastBounds.end()) {
+            invalidate(it->second);
+        } else if (!last->second.isApprox(it->second)) {
+            invalidate(last->second);
+            invalidate(it->second);
+        }
+    }
+    for (map<const Shape*, AABB>::iterator it = lastBounds.begin(); it != lastBounds.end(); ++it) {
+        if (bounds.find(it->first) == bounds.end()) invalidate(it->second);
+    }
+
+    lastBounds = bounds;
+}
+
+int IrradianceCache::size() const {
+    int total = 0;
+    vector<const Node*> stack(1, root);
+    while (!stack.empty()) {
+        const Node *node = stack.back();
+        stack.pop_back();
+        total += node->records.size();
+        for (int c = 0; c < 8; ++c) {
+            if (node->children[c] != NULL) stack.push_back(node->children[c]);
+        }
+    }
+    return total;
+}
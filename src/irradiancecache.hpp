@@ -0,0 +1,72 @@
+#ifndef IRRADIANCECACHE_H
+#define IRRADIANCECACHE_H
+
+#include "SETTINGS.hpp"
+#include "shape.hpp"
+#include <map>
+#include <vector>
+
+class Scene;
+
+using namespace std;
+
+// Sparse cache of indirect diffuse light (Ward-style irradiance caching).
+// Each record gathers one bounce of incoming light over the hemisphere at
+// a point. Points close enough to records, in position and normal, reuse a
+// weighted blend of them instead of gathering again.
+//
+// Records are kept in a loose octree and survive between animation frames;
+// update() drops only the ones near shapes that moved.
+class IrradianceCache {
+private:
+    struct Record {
+        Point position;
+        Vector normal;
+        Color irradiance;
+        Real radius; // Harmonic mean distance to the surfaces seen from here
+    };
+
+    // Records sit in the deepest node whose half size is at least their
+    // valid radius, so they reach at most one half size past the node
+    struct Node {
+        Point center;
+        Real halfSize;
+        vector<Record> records;
+        Node *children[8];
+
+        Node(const Point& center, Real halfSize);
+        ~Node();
+    };
+
+    Node *root;
+    map<const Shape*, AABB> lastBounds;
+    vector<Point> lastLights;
+
+    Real weight(const Record& r, const Point& p, const Vector& n) const;
+    void lookup(const Node* node, const Point& p, const Vector& n, Color& sum, Real& totalWeight) const;
+    void insert(const Record& r);
+    Record gather(const Point& p, const Vector& n, const Scene* scene) const;
+    void invalidate(Node* node, const AABB& region);
+
+public:
+    Real tolerance;  // Ward's a: larger reuses records further away
+    int numSamples;  // Rays per record
+    Real minSpacing; // Clamps on record radius, in world units
+    Real maxSpacing;
+
+    IrradianceCache(const AABB& bounds, Real tolerance = 0.3, int numSamples = 64);
+    ~IrradianceCache();
+
+    // Indirect light arriving at a hit, gathering a new record if no cached
+    // ones are close enough
+    Color getIrradiance(const Intersection* i, const Scene* scene);
+
+    // Drop records near anything that has moved since the last call
+    void update(const Scene* scene);
+    // Drop records whose neighbourhood overlaps region
+    void invalidate(const AABB& region);
+    void clear();
+    int size() const;
+};
+
+#endif
@@ -11,6 +11,12 @@ class Light: public Shape {
 public:
     virtual Point getPositionForIntersection(const Intersection* i) = 0;
     virtual Color getLightForIntersection(const Intersection& i, const Scene* scn) = 0;
+
+    // For light selection (see LightTree). Local lights sit somewhere in the
+    // scene and can be sampled; the rest are evaluated at every point.
+    virtual bool isLocal() const { return false; }
+    virtual Point getCenter() const { return origin; }
+    virtual Real getPower() const { return 0; }
 };
 
 class AmbientLight: public Light {
@@ -32,7 +38,7 @@ public:
         Real tMax = direction.norm() - RAY_T_MIN;
         Ray shadowRay(origin, direction);
         Intersection shadowInter(shadowRay);
-        scn->shapes.shadowIntersect(shadowInter);
+        scn->shadowIntersect(shadowInter, i, tMax);
 
         if ((shadowInter.intersected) && (shadowInter.t < tMax) && (shadowInter.t > RAY_T_MIN)){
             return Color(0,0,0);
@@ -66,14 +72,13 @@ public:
     }
 
     Color getLightForIntersection(const Intersection& i, const Scene* scn) {
-        Vector origin = getPositionForIntersection(&i);
-        Vector direction = (i.getPosition() - origin);
-        Real tMax = direction.norm() - RAY_T_MIN;
-        Ray shadowRay(origin, direction);
+        // Trace from the surface towards the sun rather than back from
+        // SUN_DISTANCE away, where floats can't resolve RAY_T_MIN
+        Ray shadowRay(i.getPosition(), -direction);
         Intersection shadowInter(shadowRay);
-        scn->shapes.shadowIntersect(shadowInter);
+        scn->shadowIntersect(shadowInter, i, REAL_MAX);
 
-        if ((shadowInter.intersected) && (shadowInter.t < tMax) && (shadowInter.t > RAY_T_MIN)){
+        if ((shadowInter.intersected) && (shadowInter.t > RAY_T_MIN)){
             return Color(0,0,0);
         } else {
             return color;
@@ -105,6 +110,9 @@ public:
         return origin;
     }
 
+    bool isLocal() const { return true; }
+    Point getCenter() const { return origin; }
+    Real getPower() const { return color.mean(); }
 
     Color getLightForIntersection(const Intersection& i, const Scene* scn) {
         Point pos = getPositionForIntersection(&i);
@@ -112,7 +120,7 @@ public:
         Real tMax = direction.norm() - RAY_T_MIN;
         Ray shadowRay(pos, direction);
         Intersection shadowInter(shadowRay);
-        scn->shapes.shadowIntersect(shadowInter);
+        scn->shadowIntersect(shadowInter, i, tMax);
 
         if (castShadows && (shadowInter.intersected) && (shadowInter.t < tMax) && (shadowInter.t > RAY_T_MIN)){
             return Color(0,0,0);
@@ -137,10 +145,60 @@ public:
 
 };
 
+// Shadow rays traced before deciding whether a point is in the penumbra
+#define SOFT_LIGHT_PROBES 4
+
 class SoftSphereLight: public PointLight {
 private:
     Real radius;
     int numSamples;
+
+    // Point on the sphere for the k-th sample of a rotated R2 sequence.
+    // Every prefix of the sequence is evenly spread, so the first few probes
+    // already cover the whole light.
+    Point getSamplePosition(const Point& p, int k, Real jitterU, Real jitterV) const {
+        Real u = fmod(jitterU + k * 0.7548776662466927, 1.0);
+        Real v = fmod(jitterV + k * 0.5698402909980532, 1.0);
+        Real phi = 2 * M_PI * v;
+
+        Vector axis = origin - p;
+        Real dist = axis.norm();
+
+        if (dist <= radius) {
+            // Inside the light, any point on it will do
+            Real z = 1 - 2 * u;
+            Real s = sqrt(std::max((Real) 0, 1 - z * z));
+            return origin + radius * Vector(s * cos(phi), s * sin(phi), z);
+        }
+
+        // Uniform over the cone of directions the sphere covers from p
+        axis /= dist;
+        Vector helper = (fabs(axis.x()) > 0.9)? Vector(0,1,0) : Vector(1,0,0);
+        Vector t = axis.cross(helper).normalized();
+        Vector b = axis.cross(t);
+
+        Real sinMax2 = (radius * radius) / (dist * dist);
+        Real cosMax = sqrt(std::max((Real) 0, 1 - sinMax2));
+        Real cosTheta = 1 - u * (1 - cosMax);
+        Real sinTheta = sqrt(std::max((Real) 0, 1 - cosTheta * cosTheta));
+
+        Vector w = (sinTheta * cos(phi)) * t + (sinTheta * sin(phi)) * b + cosTheta * axis;
+
+        // Nearest point where w meets the sphere
+        Real tHit = dist * cosTheta - sqrt(std::max((Real) 0, radius * radius - dist * dist * sinTheta * sinTheta));
+        return p + tHit * w;
+    }
+
+    bool isVisible(const Intersection& i, const Point& pos, const Scene* scn) const {
+        Vector direction = (i.getPosition() - pos);
+        Real tMax = direction.norm() - RAY_T_MIN;
+        Ray shadowRay(pos, direction);
+        Intersection shadowInter(shadowRay);
+        scn->shadowIntersect(shadowInter, i, tMax);
+
+        return !((shadowInter.intersected) && (shadowInter.t < tMax) && (shadowInter.t > RAY_T_MIN));
+    }
+
 public:
     SoftSphereLight(Vector origin, Color color, Real radius, int numSamples)
         : PointLight(origin, color), radius(radius), numSamples(numSamples) {}
@@ -148,32 +206,36 @@ public:
         : PointLight(origin, color, castShadows), radius(radius), numSamples(numSamples) {}
 
     Point getPositionForIntersection(const Intersection *i) override {
-        Vector offset;
-        for (int i = 0; i < 3; ++i) {
-            offset[i] = (((Real) rand() / RAND_MAX) - 0.5) * radius;
-        }
-        offset.normalize();
-        offset *= radius;
-        return origin + offset;
+        // Uniform on the sphere
+        Real z = 1 - 2 * ((Real) rand() / RAND_MAX);
+        Real phi = 2 * M_PI * ((Real) rand() / RAND_MAX);
+        Real s = sqrt(std::max((Real) 0, 1 - z * z));
+        return origin + radius * Vector(s * cos(phi), s * sin(phi), z);
     }
 
     Color getLightForIntersection(const Intersection& i, const Scene* scn) override {
-        Color sum(0,0,0);
-        for (int j = 0; j < numSamples; ++j) {
-            Point pos = getPositionForIntersection(&i);
-            Vector direction = (i.getPosition() - pos);
-            Real tMax = direction.norm() - RAY_T_MIN;
-            Ray shadowRay(pos, direction);
-            Intersection shadowInter(shadowRay);
-            scn->shapes.shadowIntersect(shadowInter);
-
-            if (castShadows && (shadowInter.intersected) && (shadowInter.t < tMax) && (shadowInter.t > RAY_T_MIN)){
-                sum += Color(0,0,0);
-            } else {
-                sum += color;
-            }
+        if (!castShadows) return color;
+
+        Point p = i.getPosition();
+        Real jitterU = (Real) rand() / RAND_MAX;
+        Real jitterV = (Real) rand() / RAND_MAX;
+
+        // Trace a few probes first. If they all agree the point is fully lit
+        // or fully shadowed, and only penumbra points get the rest.
+        int probes = std::min(numSamples, SOFT_LIGHT_PROBES);
+        int visible = 0;
+        for (int k = 0; k < probes; ++k) {
+            if (isVisible(i, getSamplePosition(p, k, jitterU, jitterV), scn)) visible++;
+        }
+
+        if (visible == 0) return Color(0,0,0);
+        if (visible == probes) return color;
+
+        for (int k = probes; k < numSamples; ++k) {
+            if (isVisible(i, getSamplePosition(p, k, jitterU, jitterV), scn)) visible++;
         }
-        return sum / numSamples;
+
+        return color * ((Real) visible / numSamples);
     }
 
 
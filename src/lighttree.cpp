@@ -0,0 +1,95 @@
+#include "lighttree.hpp"
+#include "light.hpp"
+
+// ==================== LightTree ======================
+
+void LightTree::build(const vector<Light*>& lights) {
+    nodes.clear();
+    if (lights.empty()) return;
+
+    vector<Light*> sorted(lights);
+    nodes.reserve(2 * lights.size() - 1);
+    build(sorted, 0, sorted.size());
+}
+
+int LightTree::build(vector<Light*>& lights, int start, int end) {
+    int index = nodes.size();
+    nodes.push_back(Node());
+
+    if (end - start == 1) {
+        Light *light = lights[start];
+        Node& leaf = nodes[index];
+        leaf.min = leaf.max = light->getCenter();
+        leaf.power = light->getPower();
+        leaf.left = leaf.right = -1;
+        leaf.light = light;
+        return index;
+    }
+
+    // Split at the median along the widest axis of the light centers
+    Vec3 cmin = lights[start]->getCenter(), cmax = cmin;
+    for (int l = start + 1; l < end; ++l) {
+        cmin = cmin.cwiseMin(lights[l]->getCenter());
+        cmax = cmax.cwiseMax(lights[l]->getCenter());
+    }
+
+    int axis;
+    (cmax - cmin).maxCoeff(&axis);
+
+    int mid = (start + end) / 2;
+    nth_element(lights.begin() + start, lights.begin() + mid, lights.begin() + end,
+                [axis](Light *a, Light *b) { return a->getCenter()[axis] < b->getCenter()[axis]; });
+
+    int left = build(lights, start, mid);
+    int right = build(lights, mid, end);
+
+    // nodes may have reallocated, so only take the reference now
+    Node& node = nodes[index];
+    node.left = left;
+    node.right = right;
+    node.light = nullptr;
+    node.min = nodes[left].min.cwiseMin(nodes[right].min);
+    node.max = nodes[left].max.cwiseMax(nodes[right].max);
+    node.power = nodes[left].power + nodes[right].power;
+
+    return index;
+}
+
+Real LightTree::importance(const Node& node, const Point& p) const {
+    Point center = (node.min + node.max) / 2;
+    Real radius2 = (node.max - node.min).squaredNorm() / 4;
+
+    // Don't let clusters containing p (or lights right on it) blow up
+    Real dist2 = std::max((center - p).squaredNorm(), radius2);
+    dist2 = std::max(dist2, (Real) SURFACE_EPS);
+
+    return node.power / dist2;
+}
+
+Light* LightTree::sample(const Point& p, Real u, Real& pdf) const {
+    pdf = 1;
+    if (nodes.empty()) return nullptr;
+
+    int index = 0;
+    while (nodes[index].light == nullptr) {
+        const Node& node = nodes[index];
+        Real wl = importance(nodes[node.left], p);
+        Real wr = importance(nodes[node.right], p);
+
+        Real pl = (wl + wr > 0)? wl / (wl + wr) : 0.5;
+
+        // Reuse u for the next level by rescaling it into [0, 1)
+        if (u < pl) {
+            u = u / pl;
+            pdf *= pl;
+            index = node.left;
+        } else {
+            u = (u - pl) / (1 - pl);
+            pdf *= 1 - pl;
+            index = node.right;
+        }
+        u = std::min(u, (Real) 0.999999);
+    }
+
+    return nodes[index].light;
+}
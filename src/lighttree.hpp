@@ -0,0 +1,48 @@
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include "SETTINGS.hpp"
+#include <vector>
+
+class Light;
+
+using namespace std;
+
+// A light picked for a shading point, and what its contribution has to be
+// multiplied by to make up for the lights that weren't picked
+struct LightSample {
+    Light *light;
+    Real weight;
+};
+
+// Bounding volume hierarchy over local lights, with the total power under
+// each node. Sampling walks down from the root, picking a child in
+// proportion to its power over its squared distance from the shading
+// point, so a light is found in O(log n) and nearby bright lights are
+// favoured.
+class LightTree {
+private:
+    struct Node {
+        Vec3 min, max;
+        Real power;
+        int left, right; // Children, -1 for leaves
+        Light *light;    // Only set for leaves
+
+        Node(): min(0,0,0), max(0,0,0), power(0), left(-1), right(-1), light(nullptr) {}
+    };
+
+    vector<Node> nodes;
+
+    int build(vector<Light*>& lights, int start, int end);
+    Real importance(const Node& node, const Point& p) const;
+
+public:
+    void build(const vector<Light*>& lights);
+    int size() const { return (nodes.size() + 1) / 2; }
+    bool empty() const { return nodes.empty(); }
+
+    // Pick one light for p, using u in [0, 1). pdf is the chance it was picked.
+    Light* sample(const Point& p, Real u, Real& pdf) const;
+};
+
+#endif
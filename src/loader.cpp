@@ -0,0 +1,78 @@
+#include "loader.hpp"
+
+// ==================== ThreadPool ======================
+
+ThreadPool::ThreadPool(int numThreads): stopping(false) {
+    if (numThreads <= 0) numThreads = thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+
+    for (int i = 0; i < numThreads; ++i) {
+        workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return; // Only reached when stopping
+            job = jobs.front();
+            jobs.pop();
+        }
+        job();
+    }
+}
+
+// ==================== AssetLoader ======================
+
+AssetLoader::~AssetLoader() {
+    for (size_t i = 0; i < textures.size(); ++i) {
+        delete textures[i];
+    }
+}
+
+ImageTexture* AssetLoader::keep(ImageTexture* texture) {
+    lock_guard<mutex> lock(ownedMutex);
+    textures.push_back(texture);
+    return texture;
+}
+
+shared_future<ImageTexture*> AssetLoader::loadTexture(const string& filename, Real scale, bool tile) {
+    return pool.submit<ImageTexture*>([=]() {
+        return keep(new ImageTexture(filename, scale, tile));
+    });
+}
+
+shared_future<ImageTexture*> AssetLoader::loadTexture(const string& filename, Real scale, bool tile, Color background) {
+    return pool.submit<ImageTexture*>([=]() {
+        return keep(new ImageTexture(filename, scale, tile, background));
+    });
+}
+
+shared_future<Skeleton*> AssetLoader::loadSkeleton(const string& asfFilename, double scale) {
+    return pool.submit<Skeleton*>([=]() {
+        Skeleton* skeleton = new Skeleton(asfFilename.c_str(), scale);
+        skeleton->setBasePosture();
+        return skeleton;
+    });
+}
+
+shared_future<Motion*> AssetLoader::loadMotion(const string& amcFilename, shared_future<Skeleton*> skeleton, double scale) {
+    return pool.submit<Motion*>([=]() {
+        return new Motion(amcFilename.c_str(), scale, skeleton.get());
+    });
+}
@@ -0,0 +1,76 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "SETTINGS.hpp"
+#include "texture.hpp"
+#include "Mocap/skeleton.h"
+#include "Mocap/motion.h"
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size pool of worker threads consuming a FIFO of jobs.
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()>> jobs;
+    mutex jobMutex;
+    condition_variable jobReady;
+    bool stopping;
+
+    void workerLoop();
+
+public:
+    ThreadPool(int numThreads = 0); // 0 means one thread per hardware core
+    ~ThreadPool();
+
+    int size() const { return workers.size(); }
+
+    template <typename T>
+    shared_future<T> submit(function<T()> job) {
+        shared_ptr<packaged_task<T()>> task = make_shared<packaged_task<T()>>(job);
+        shared_future<T> result = task->get_future().share();
+        {
+            lock_guard<mutex> lock(jobMutex);
+            jobs.push([task]() { (*task)(); });
+        }
+        jobReady.notify_one();
+        return result;
+    }
+};
+
+// Decodes scene assets concurrently and hands back futures, so scene setup
+// only waits on the slowest asset rather than the sum of all of them.
+//
+// Textures stay owned by the loader and live as long as it does. Skeletons
+// and motions are handed over to whoever displays them (see DisplaySkeleton).
+class AssetLoader {
+private:
+    ThreadPool pool;
+    mutex ownedMutex;
+    vector<ImageTexture*> textures;
+
+    ImageTexture* keep(ImageTexture* texture);
+
+public:
+    AssetLoader(int numThreads = 0): pool(numThreads) {}
+    ~AssetLoader();
+
+    shared_future<ImageTexture*> loadTexture(const string& filename, Real scale = 1, bool tile = false);
+    shared_future<ImageTexture*> loadTexture(const string& filename, Real scale, bool tile, Color background);
+
+    shared_future<Skeleton*> loadSkeleton(const string& asfFilename, double scale = MOCAP_SCALE);
+    // Motions are parsed against their skeleton, so this waits on it from the worker thread.
+    shared_future<Motion*> loadMotion(const string& amcFilename, shared_future<Skeleton*> skeleton, double scale = MOCAP_SCALE);
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <vector>
 #include <iostream>
@@ -12,10 +13,13 @@
 #include "cylinder.hpp"
 #include "capsule.hpp"
 #include "cylinderskeleton.hpp"
+#include "skeletonshape.hpp"
 #include "image.hpp"
 #include "intersection.hpp"
 #include "light.hpp"
+#include "loader.hpp"
 #include "material.hpp"
+#include "motionblur.hpp"
 #include "normalmap.hpp"
 #include "perlin.hpp"
 #include "plane.hpp"
@@ -35,7 +39,7 @@ inline Real deg2rad(Real deg) {
     return deg * M_PI / 180.0;
 }
 
-void mainScene(int startFrame, int stopFrame){
+void mainScene(int startFrame, int stopFrame, bool reuseFrames){
 
     int width = 800;
     int height = 600;
@@ -44,19 +48,42 @@ void mainScene(int startFrame, int stopFrame){
     PerspectiveCamera pc(Point(-2.5,3,-6.125), Point(-2,0,0), Vector(0,1,0), deg2rad(65), (float) width / height, 1, 0.025, 0.9); // AS 0.05
     pc.samplesPerPixel = 17;
     pc.blurCompensation = true;
+    pc.shutter = 0.5;
     // pc.samplesPerPixel = 1;
     // pc.blurCompensation = false;
 
+    // Decode every texture and mocap clip concurrently up front. Each get()
+    // below only blocks on its own asset, so setup costs about as much as the
+    // largest asset instead of all of them. The long mocap clips go first.
+    AssetLoader loader;
+    shared_future<Skeleton*> linda_skel = loader.loadSkeleton("data/skeleton/80.asf");
+    shared_future<Motion*> linda_motion = loader.loadMotion("data/skeleton/80_12.amc", linda_skel);
+    shared_future<Skeleton*> jenny_skel = loader.loadSkeleton("data/skeleton/02.asf");
+    shared_future<Motion*> jenny_motion = loader.loadMotion("data/skeleton/02_01.amc", jenny_skel);
+
+    shared_future<ImageTexture*> skyc_tex = loader.loadTexture("data/textures/skybox_mountain.ppm", 1, false);
+    shared_future<ImageTexture*> ground_c_tex = loader.loadTexture("data/textures/sand_color.ppm", 5, true);
+    shared_future<ImageTexture*> wood_c_tex = loader.loadTexture("data/textures/wood_color.ppm", 1, true);
+    shared_future<ImageTexture*> wood_s_tex = loader.loadTexture("data/textures/wood_spec.ppm", 1, true);
+    shared_future<ImageTexture*> orange_n_tex = loader.loadTexture("data/textures/orange_normal.ppm", 0.5, true);
+    shared_future<ImageTexture*> orange_s_tex = loader.loadTexture("data/textures/orange_spec.ppm", 0.5, true);
+    shared_future<ImageTexture*> apple_c_tex = loader.loadTexture("data/textures/apple_color.ppm");
+    shared_future<ImageTexture*> bite_c_tex = loader.loadTexture("data/textures/bite_color.ppm");
+
     // Background + Scene
     SolidColor bg(Color(0,0,0));
-    ImageTexture skyc("data/textures/skybox_mountain.ppm", 1, false);
+    ImageTexture& skyc = *skyc_tex.get();
     Skybox skybox(&skyc);
     Scene scn = Scene(&skybox);
 
+    // Spheres, cylinders and capsules for the props, kept side by side
+    ShapePool<Sphere> spheres;
+    ShapePool<Cylinder> cylinders;
+    ShapePool<Capsule> capsules;
+
     // Ground
     SolidColor ground_sc(Color::fromHex("#79693D"));
-    ImageTexture ground_c("data/textures/sand_color.ppm", 5, true);
-    ImageTexture ground_n("data/textures/sand_normal.ppm", 5, true);
+    ImageTexture& ground_c = *ground_c_tex.get();
 
     Diffuse ground_dif(&ground_c);
 
@@ -74,15 +101,14 @@ void mainScene(int startFrame, int stopFrame){
     SolidColor red(0.3,0.1,0.1);
     Diffuse green_d(&green);
     Diffuse red_d(&red);
-    CylinderSkeleton jenny("data/skeleton/02.asf", "data/skeleton/02_01.amc", &green_d, 0, Vector(1,1,-1), Point(0,0,0));
-    CylinderSkeleton linda("data/skeleton/80.asf", "data/skeleton/80_12.amc", &red_d, 0, Vector(1,1,1), Point(1,0,3));
+    SkeletonShape jenny(jenny_skel.get(), jenny_motion.get(), &green_d, 0, Vector(1,1,-1), Point(0,0,0));
+    SkeletonShape linda(linda_skel.get(), linda_motion.get(), &red_d, 0, Vector(1,1,1), Point(1,0,3));
 
-    Capsule arm(Point(-2, 3, -5.3), Point(-1, 3.25, -5.3), 0.12, Vector(1,0,0), &green_d);
+    Capsule& arm = *capsules.make(Point(-2, 3, -5.3), Point(-1, 3.25, -5.3), 0.12, Vector(1,0,0), &green_d);
 
     // Table
-    ImageTexture wood_c("data/textures/wood_color.ppm", 1, true);
-    ImageTexture wood_n("data/textures/wood_normal.ppm", 1, true);
-    ImageTexture wood_s("data/textures/wood_spec.ppm", 1, true);
+    ImageTexture& wood_c = *wood_c_tex.get();
+    ImageTexture& wood_s = *wood_s_tex.get();
 
     Diffuse wood_dif(&wood_c);
     Specular wood_spec(&wood_c, 10);
@@ -96,7 +122,7 @@ void mainScene(int startFrame, int stopFrame){
     Diffuse offwhite_d(&offwhite);
     Glossy refl(&offwhite, 1, 3, 1); //TODO increase for final render
     ConstMix ceramic(&offwhite_d, &refl, 0.6);
-    Cylinder plateBody(Point(-2.25, 2.5, -5), Vector(0,1,0), 0.6, 0.025, Vector(1,0,0), &offwhite_d);
+    Cylinder& plateBody = *cylinders.make(Point(-2.25, 2.5, -5), Vector(0,1,0), 0.6, 0.025, Vector(1,0,0), &offwhite_d);
     Circle plateTop(Point(-2.25, 2.5251, -5), Vector(0,1,0), 0.6, Vector(1,0,0), &ceramic);
     ShapeGroup plate{};
     plate.addShape(&plateBody);
@@ -104,8 +130,8 @@ void mainScene(int startFrame, int stopFrame){
 
     // Orange
     SolidColor orange_sc(Color::fromHex("#FE7400"));
-    ImageTexture orange_n("data/textures/orange_normal.ppm", 0.5, true);
-    ImageTexture orange_s("data/textures/orange_spec.ppm", 0.5, true);
+    ImageTexture& orange_n = *orange_n_tex.get();
+    ImageTexture& orange_s = *orange_s_tex.get();
 
     Diffuse orange_dif(&orange_sc);
     Specular orange_spec(&orange_sc, 10);
@@ -113,24 +139,28 @@ void mainScene(int startFrame, int stopFrame){
     Multiply orange_spec_mix = orange_spec * orange_s;
     Add orange_m = orange_spec_mix + orange_dif;
 
-    Sphere orange(Point(-2.5, 2.7751, -5), Vector(0,1,0), Vector(1,0,0), 0.25, &orange_m);
+    Sphere& orange = *spheres.make(Point(-2.5, 2.7751, -5), Vector(0,1,0), Vector(1,0,0), 0.25, &orange_m);
     NormalMap orange_nm(&orange, &orange_n, &scn, 0.2);
 
     // Apple
-    ImageTexture apple_c("data/textures/apple_color.ppm");
+    ImageTexture& apple_c = *apple_c_tex.get();
     Diffuse apple_dif(&apple_c);
     Specular apple_spec(&apple_c, 10);
     Add apple_m = apple_spec + apple_dif;
 
-    ImageTexture bite_c("data/textures/bite_color.ppm");
+    ImageTexture& bite_c = *bite_c_tex.get();
     Phong bite_m(&bite_c, 80);
 
-    Sphere apple(Point(-2, 2.7752, -5.1), Vector(0,1,0), Vector(1,0,0), 0.25, &apple_m);
-    Sphere apple_copy(apple);
-    Sphere bite(Point(-1.95, 3, -5.2), Vector(0,1,0), Vector(1,0,0), 0.1875, &bite_m);
+    Sphere& apple = *spheres.make(Point(-2, 2.7752, -5.1), Vector(0,1,0), Vector(1,0,0), 0.25, &apple_m);
+    Sphere& apple_copy = *spheres.make(apple);
+    Sphere& bite = *spheres.make(Point(-1.95, 3, -5.2), Vector(0,1,0), Vector(1,0,0), 0.1875, &bite_m);
 
     CSGDifference bitten(&apple_copy, &bite);
 
+    // What the arm moves is blurred over the shutter
+    MotionBlur arm_blur(&arm, pc.shutter);
+    MotionBlur apple_blur(&apple, pc.shutter);
+    MotionBlur bitten_blur(&bitten, pc.shutter);
 
     // Glasses
     SolidColor brown1_c(Color::fromHex("#A16900"));
@@ -147,30 +177,30 @@ void mainScene(int startFrame, int stopFrame){
 
     Point lens_l_center(-3, 2.625, -4.975);
 
-    Cylinder frame_lo(Point(-3, 2.625, -5), Point(-3, 2.625, -4.95), 0.125, Vector(1,0,0), &glasses_m);
-    Cylinder frame_li(Point(-3, 2.625, -5.001), Point(-3, 2.625, -4.9499), 0.1, Vector(1,0,0), &glasses_m);
+    Cylinder& frame_lo = *cylinders.make(Point(-3, 2.625, -5), Point(-3, 2.625, -4.95), 0.125, Vector(1,0,0), &glasses_m);
+    Cylinder& frame_li = *cylinders.make(Point(-3, 2.625, -5.001), Point(-3, 2.625, -4.9499), 0.1, Vector(1,0,0), &glasses_m);
     CSGDifference frame_l(&frame_lo, &frame_li);
 
-    Sphere lens_l1(lens_l_center + lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
-    Sphere lens_l2(lens_l_center - lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
+    Sphere& lens_l1 = *spheres.make(lens_l_center + lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
+    Sphere& lens_l2 = *spheres.make(lens_l_center - lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
     CSGIntersection lens_l(&lens_l1, &lens_l2);
 
     Point lens_r_center(-3.325, 2.625, -4.975);
 
-    Cylinder frame_ro(Point(-3.325, 2.625, -5), Point(-3.325, 2.625, -4.95), 0.125, Vector(1,0,0), &glasses_m);
-    Cylinder frame_ri(Point(-3.325, 2.625, -5.001), Point(-3.325, 2.625, -4.9499), 0.1, Vector(1,0,0), &glasses_m);
+    Cylinder& frame_ro = *cylinders.make(Point(-3.325, 2.625, -5), Point(-3.325, 2.625, -4.95), 0.125, Vector(1,0,0), &glasses_m);
+    Cylinder& frame_ri = *cylinders.make(Point(-3.325, 2.625, -5.001), Point(-3.325, 2.625, -4.9499), 0.1, Vector(1,0,0), &glasses_m);
     CSGDifference frame_r(&frame_ro, &frame_ri);
 
-    Sphere lens_r1(lens_r_center + lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
-    Sphere lens_r2(lens_r_center - lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
+    Sphere& lens_r1 = *spheres.make(lens_r_center + lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
+    Sphere& lens_r2 = *spheres.make(lens_r_center - lens_offset, lens_offset.norm() + lens_thickness, &lens_m);
     CSGIntersection lens_r(&lens_r1, &lens_r2);
 
-    Cylinder nose(Point(-3.225, 2.625, -4.975), Point(-3.1, 2.625, -4.975), 0.025, Vector(0,1,0), &glasses_m);
+    Cylinder& nose = *cylinders.make(Point(-3.225, 2.625, -4.975), Point(-3.1, 2.625, -4.975), 0.025, Vector(0,1,0), &glasses_m);
 
-    Capsule arm_l(Point(-3.45, 2.625, -4.98), Point(-3.45, 2.625, -4.5), 0.02, Vector(0,1,0), &glasses_m);
-    Capsule ear_l(Point(-3.45, 2.625, -4.5), Point(-3.45, 2.52, -4.4), 0.02, Vector(0,1,0), &glasses_m);
-    Capsule arm_r(Point(-2.875, 2.625, -4.98), Point(-2.875, 2.625, -4.5), 0.02, Vector(0,1,0), &glasses_m);
-    Capsule ear_r(Point(-2.875, 2.625, -4.5), Point(-2.875, 2.52, -4.4), 0.02, Vector(0,1,0), &glasses_m);
+    Capsule& arm_l = *capsules.make(Point(-3.45, 2.625, -4.98), Point(-3.45, 2.625, -4.5), 0.02, Vector(0,1,0), &glasses_m);
+    Capsule& ear_l = *capsules.make(Point(-3.45, 2.625, -4.5), Point(-3.45, 2.52, -4.4), 0.02, Vector(0,1,0), &glasses_m);
+    Capsule& arm_r = *capsules.make(Point(-2.875, 2.625, -4.98), Point(-2.875, 2.625, -4.5), 0.02, Vector(0,1,0), &glasses_m);
+    Capsule& ear_r = *capsules.make(Point(-2.875, 2.625, -4.5), Point(-2.875, 2.52, -4.4), 0.02, Vector(0,1,0), &glasses_m);
 
     ShapeGroup glasses{};
     glasses.addShape(&frame_l);
@@ -188,9 +218,9 @@ void mainScene(int startFrame, int stopFrame){
     Mirror glass_r(&white, 10);
     ConstMix glass_m(&glass_f, &glass_r, 0.95);
 
-    Cylinder glass_o(Point(-3, 2.5, -4), Point(-3, 3, -4), 0.175, Vector(1,0,0), &glass_m);
-    Cylinder glass_i(Point(-3, 2.525, -4), Point(-3, 3.025, -4), 0.165, Vector(1,0,0), &glass_m);
-    Cylinder milk(Point(-3, 2.525, -4), Point(-3, 2.9, -4), 0.165, Vector(1,0,0), &offwhite_d);
+    Cylinder& glass_o = *cylinders.make(Point(-3, 2.5, -4), Point(-3, 3, -4), 0.175, Vector(1,0,0), &glass_m);
+    Cylinder& glass_i = *cylinders.make(Point(-3, 2.525, -4), Point(-3, 3.025, -4), 0.165, Vector(1,0,0), &glass_m);
+    Cylinder& milk = *cylinders.make(Point(-3, 2.525, -4), Point(-3, 2.9, -4), 0.165, Vector(1,0,0), &offwhite_d);
 
     CSGDifference glass(&glass_o, &glass_i);
     glass.castShadows = false;
@@ -228,18 +258,22 @@ void mainScene(int startFrame, int stopFrame){
     rippler.addKeyframe(300,20);
 
     // Skeleton movement
-    ValueAnimator<int> sa(&jenny.frameIdx, &jenny);
+    ValueAnimator<Real> sa(&jenny.frameTime, &jenny);
     sa.interpolationFunction = InterpolationFunctions::lerp;
     sa.addKeyframe(0, 50);
     sa.addKeyframe(70, 350);
 
-    ValueAnimator<int> sa2(&linda.frameIdx, &linda);
+    ValueAnimator<Real> sa2(&linda.frameTime, &linda);
     sa2.interpolationFunction = InterpolationFunctions::lerp;
     sa2.addKeyframe(0, 50);
     sa2.addKeyframe(300, 1239);
 
+    // Pose both skeletons for every frame being rendered before starting
+    jenny.precompute(sa, startFrame, stopFrame);
+    linda.precompute(sa2, startFrame, stopFrame);
+
     // Arm visibility
-    VisibleAnimator arm_vis(&arm, &scn.shapes);
+    VisibleAnimator arm_vis(&arm_blur, &scn.shapes);
     arm_vis.addKeyframe(0, false);
     arm_vis.addKeyframe(70, true);
 
@@ -258,11 +292,11 @@ void mainScene(int startFrame, int stopFrame){
     apple_move.addKeyframe(105, Point(0.5,0.75,0));
 
     // Swap apple
-    VisibleAnimator apple_vis(&apple, &scn.shapes);
+    VisibleAnimator apple_vis(&apple_blur, &scn.shapes);
     apple_vis.addKeyframe(0, true);
     apple_vis.addKeyframe(105, false);
 
-    VisibleAnimator bitten_vis(&bitten, &scn.shapes);
+    VisibleAnimator bitten_vis(&bitten_blur, &scn.shapes);
     bitten_vis.addKeyframe(0, false);
     bitten_vis.addKeyframe(105, true);
 
@@ -292,6 +326,12 @@ void mainScene(int startFrame, int stopFrame){
     b_wobbler.addKeyframe(149,deg2rad(2));
     b_wobbler.addKeyframe(153,0);
 
+    arm_blur.follow(&arm_move);
+    apple_blur.follow(&apple_move);
+    bitten_blur.follow(&bitten_move);
+    // Both halves wobble together, so one of them is enough
+    bitten_blur.follow(&a_wobbler);
+
     // Move arm away
     arm_move.addKeyframe(145, Point(0,0,0));
     arm_move.addKeyframe(155, Point(0.5, -0.1, -0.1));
@@ -328,10 +368,10 @@ void mainScene(int startFrame, int stopFrame){
     cameraFocus.addKeyframe(190, 0.001);
 
     Animator anim{};
-    anim.addAnimation(&sa);
-    anim.addAnimation(&sa2);
+    anim.addAnimation(&sa, &jenny);
+    anim.addAnimation(&sa2, &linda);
 
-    anim.addAnimation(&rippler);
+    anim.addAnimation(&rippler, &water);
     anim.addAnimation(&arm_vis);
     anim.addAnimation(&apple_vis);
     anim.addAnimation(&bitten_vis);
@@ -339,8 +379,11 @@ void mainScene(int startFrame, int stopFrame){
     anim.addAnimation(&arm_move);
     anim.addAnimation(&apple_move);
     anim.addAnimation(&bitten_move);
-    anim.addAnimation(&a_wobbler);
-    anim.addAnimation(&b_wobbler);
+    anim.addAnimation(&a_wobbler, &bitten_blur);
+    anim.addAnimation(&b_wobbler, &bitten_blur);
+    anim.addAnimation(&arm_blur);
+    anim.addAnimation(&apple_blur);
+    anim.addAnimation(&bitten_blur);
 
     anim.addAnimation(&cmove);
     anim.addAnimation(&trackPointAnimator);
@@ -348,6 +391,11 @@ void mainScene(int startFrame, int stopFrame){
     anim.addAnimation(&camLookAt);
     anim.addAnimation(&cameraFocus);
 
+    // Only trace pixels again where something changed since the last frame.
+    // The grid covers the table and the skeletons.
+    TemporalCache reuse(AABB(Point(-6,-0.5,-9), Point(4,7,6)));
+    if (reuseFrames && stopFrame > startFrame) scn.temporal = &reuse;
+
     // scn.makePreviz();
     anim.render(&pc, &scn, "frames", width, height, startFrame, stopFrame, 1);
     // scn.freePreviz();
@@ -363,6 +411,10 @@ int main(int argc, char** argv) {
         exit(0);
     }
 
+    // A trailing "reuse" copies unchanged pixels from the frame before
+    bool reuseFrames = (argc > 2 && strcmp(argv[argc - 1], "reuse") == 0);
+    if (reuseFrames) --argc;
+
     if (argc < 3) {
         startFrame = stopFrame = atoi(argv[1]);
     } else {
@@ -370,7 +422,7 @@ int main(int argc, char** argv) {
         stopFrame = atoi(argv[2]);
     }
 
-    mainScene(startFrame, stopFrame);
+    mainScene(startFrame, stopFrame, reuseFrames);
 
     return 0;
 }
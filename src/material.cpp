@@ -6,6 +6,8 @@
 #include "light.hpp"
 #include "plane.hpp"
 
+#include <random>
+
 using namespace std;
 
 // ======== Material ==========
@@ -27,22 +29,33 @@ Multiply Material::operator *( const Material& other ) {
     return out;
 }
 
+void Material::sample(const Intersection* i, const Scene* scene, PathVertex& v) const {
+    v.direct = getColor(i, scene);
+}
+
 
 // ======== Diffuse ========
 Color Diffuse::getColor(const Intersection* i, const Scene* scene) const {
     Color sum(0,0,0);
-    for (int x = 0; x < scene->lights.members.size(); ++x) {
-        Light *light = scene->lights.members[x];
+    LightSample lights[MAX_SHADING_LIGHTS];
+    int numLights = scene->selectLights(*i, lights);
+    for (int x = 0; x < numLights; ++x) {
+        Light *light = lights[x].light;
         // Get vector to light
         Vector l = (light->getPositionForIntersection(i) - i->getPosition()).normalized();
 
         Real factor = l.dot(i->normal);
 
         if (factor > 0) {
-            Color lightColor = factor * light->getLightForIntersection(*i, scene);
+            Color lightColor = factor * light->getLightForIntersection(*i, scene) * lights[x].weight;
             sum += lightColor;
         }
     }
+
+    if (scene->irradiance != NULL && i->context->indirect) {
+        sum += scene->irradiance->getIrradiance(i, scene);
+    }
+
     return sum.cwiseProduct(color->getColor(i, scene));
 }
 
@@ -50,8 +63,10 @@ Color Diffuse::getColor(const Intersection* i, const Scene* scene) const {
 
 Color Specular::getColor(const Intersection* i, const Scene* scene) const {
     Color sum(0,0,0);
-    for (int x = 0; x < scene->lights.members.size(); ++x) {
-        Light *light = scene->lights.members[x];
+    LightSample lights[MAX_SHADING_LIGHTS];
+    int numLights = scene->selectLights(*i, lights);
+    for (int x = 0; x < numLights; ++x) {
+        Light *light = lights[x].light;
         // Get vector to light and normal vector, then calculate reflection
         Vector l = (light->getPositionForIntersection(i) - i->getPosition()).normalized();
         Vector n = i->normal;
@@ -62,7 +77,7 @@ Color Specular::getColor(const Intersection* i, const Scene* scene) const {
 
         Real factor = r.dot(e);
         if (factor > 0) {
-            Color lightColor = pow(factor, phongExponent) * light->getLightForIntersection(*i, scene);
+            Color lightColor = pow(factor, phongExponent) * light->getLightForIntersection(*i, scene) * lights[x].weight;
             sum += lightColor;
         }
     }
@@ -72,8 +87,10 @@ Color Specular::getColor(const Intersection* i, const Scene* scene) const {
 // ============== Phong (combined, optimized Diffuse + Specular) ==============
 Color Phong::getColor(const Intersection *i, const Scene *scene) const {
     Color sum(0,0,0);
-    for (int x = 0; x < scene->lights.members.size(); ++x) {
-        Light *light = scene->lights.members[x];
+    LightSample lights[MAX_SHADING_LIGHTS];
+    int numLights = scene->selectLights(*i, lights);
+    for (int x = 0; x < numLights; ++x) {
+        Light *light = lights[x].light;
 
         // Get vector to light and normal vector, then calculate reflection
         Vector l = (light->getPositionForIntersection(i) - i->getPosition()).normalized();
@@ -85,13 +102,13 @@ Color Phong::getColor(const Intersection *i, const Scene *scene) const {
 
         Real diffuseFactor = l.dot(i->normal);
         if (diffuseFactor > 0) {
-            Color lightColor = diffuseFactor * light->getLightForIntersection(*i, scene);
+            Color lightColor = diffuseFactor * light->getLightForIntersection(*i, scene) * lights[x].weight;
             sum += lightColor.cwiseProduct(diffuseColor->getColor(i, scene));
         }
 
         Real specularFactor = r.dot(e);
         if (specularFactor > 0) {
-            Color lightColor = pow(specularFactor, phongExponent) * light->getLightForIntersection(*i, scene);
+            Color lightColor = pow(specularFactor, phongExponent) * light->getLightForIntersection(*i, scene) * lights[x].weight;
             sum += lightColor.cwiseProduct(specularColor->getColor(i, scene));
         }
     }
@@ -103,7 +120,7 @@ Color Phong::getColor(const Intersection *i, const Scene *scene) const {
 
 Color Mirror::getColor(const Intersection *i, const Scene *scene) const {
     // Get vector to eye and normal vector, then calculate reflection
-    Vector r = RayFunctions::reflect(i->ray.dir, i->normal);
+    Vector r = RayFunctions::reflect(i->ray.direction, i->normal);
 
     Ray reflected(i->getPosition(), r);
     Intersection reflInter(reflected);
@@ -119,19 +136,52 @@ Color Mirror::getColor(const Intersection *i, const Scene *scene) const {
         reflInter.bouncesLeft = (i->bouncesLeft - 1);
     }
 
-    if (i->DEBUG) reflInter.DEBUG = true;
+    Color tint = color->getColor(i, scene);
+    RayContext reflPath;
+    if (!i->spawn(reflInter, reflPath, tint)) return Color(0,0,0);
 
-    scene->shapes.intersect(reflInter);
+    scene->intersect(reflInter);
 
     if (i->DEBUG) PRINT("REFLECTED");
 
-    return reflInter.getColor(scene).cwiseProduct(color->getColor(i, scene));
+    return reflInter.getColor(scene).cwiseProduct(tint);
+}
+
+void Mirror::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    v.continues = true;
+    v.next = Ray(i->getPosition(), RayFunctions::reflect(i->ray.direction, i->normal));
+    v.weight = color->getColor(i, scene);
 }
 
 // =============== Glossy =================
+
+// A generator seeded from position, so glossy noise doesn't flicker between
+// frames. It's kept apart from rand so the frame's own seed (see Animator)
+// isn't disturbed.
+static minstd_rand rngFromPosition(const Point& pos) {
+    // BUG Assumes that Real is hashable with std:hash
+    Point rounded_pos = Point(round(pos[0] * 1000) / 1000,
+                              round(pos[1] * 1000) / 1000,
+                              round(pos[2] * 1000) / 1000);
+    hash<Real> hasher{};
+
+    size_t h1 = hasher(rounded_pos[0]);
+    size_t h2 = hasher(rounded_pos[1]);
+    size_t h3 = hasher(rounded_pos[2]);
+
+    size_t h = (h1 ^ (h2 << 1)) ^ (h3 << 1);
+
+    return minstd_rand(h);
+}
+
+// Uniform in [0, 1)
+static Real uniform(minstd_rand& rng) {
+    return (Real) (rng() - minstd_rand::min()) / ((Real) minstd_rand::max() - minstd_rand::min() + 1);
+}
+
 Color Glossy::getColor(const Intersection *i, const Scene *scene) const {
     // Get vector to eye and normal vector, then calculate reflection
-    Vector r = RayFunctions::reflect(i->ray.dir, i->normal);
+    Vector r = RayFunctions::reflect(i->ray.direction, i->normal);
 
     Ray reflected(i->getPosition(), r);
     Intersection reflInter(reflected);
@@ -146,46 +196,157 @@ Color Glossy::getColor(const Intersection *i, const Scene *scene) const {
 
     Color sum(0,0,0);
 
-    // Seed rand based on position
-
-    // BUG Assumes that Real is hashable with std:hash
-    Point pos(i->getPosition());
-    Point rounded_pos = Point(round(pos[0] * 1000) / 1000,
-                              round(pos[1] * 1000) / 1000,
-                              round(pos[2] * 1000) / 1000);
-    hash<Real> hasher{};
-
-    size_t h1 = hasher(rounded_pos[0]);
-    size_t h2 = hasher(rounded_pos[1]);
-    size_t h3 = hasher(rounded_pos[2]);
-
-    size_t h = (h1 ^ (h2 << 1)) ^ (h3 << 1);
+    minstd_rand rng = rngFromPosition(i->getPosition());
 
-    srand(h);
+    int samples = (splitOnlyFirstBounce && i->bouncesLeft != -1)? 1 : numSamples;
+    Color tint = color->getColor(i, scene);
 
-    for (int s = 0; s < numSamples; ++s) {
+    for (int s = 0; s < samples; ++s) {
         Intersection reflSample(reflInter);
-        Real du = roughness * ((Real) rand() / (Real) RAND_MAX) - (roughness/2);
-        Real dv = roughness * ((Real) rand() / (Real) RAND_MAX) - (roughness/2);
-
-        reflSample.ray.direction += (du * i->tangent) + (dv * i->bitangent);
-        scene->shapes.intersect(reflSample);
+        Real u1 = uniform(rng);
+        reflSample.ray.direction = perturb(i, r, u1, uniform(rng));
+        RayContext samplePath;
+        if (!i->spawn(reflSample, samplePath, tint / samples)) continue;
+        scene->intersect(reflSample);
         Color c = reflSample.getColor(scene);
         // PRINTV3(c);
         sum += c;
     }
 
-    sum /= numSamples;
+    sum /= samples;
 
     // PRINTV3(sum);
 
-    return sum.cwiseProduct(color->getColor(i, scene));
+    return sum.cwiseProduct(tint);
+}
+
+Vector Glossy::perturb(const Intersection *i, const Vector& r, Real u1, Real u2) const {
+    Real du = roughness * u1 - (roughness/2);
+    Real dv = roughness * u2 - (roughness/2);
+
+    return (r + (du * i->tangent) + (dv * i->bitangent)).normalized();
+}
+
+void Glossy::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    Vector r = RayFunctions::reflect(i->ray.direction, i->normal);
+
+    Real u1 = (Real) rand() / RAND_MAX;
+    Real u2 = (Real) rand() / RAND_MAX;
+
+    v.continues = true;
+    v.next = Ray(i->getPosition(), perturb(i, r, u1, u2));
+    v.weight = color->getColor(i, scene);
+}
+
+
+// ============== GGX Glossy =================
+
+static Real smithG1(Real alpha2, Real cosTheta) {
+    return 2 * cosTheta / (cosTheta + sqrt(alpha2 + (1 - alpha2) * cosTheta * cosTheta));
+}
+
+bool GGXGlossy::sampleDirection(const Intersection *i, const Color& f0, Real u1, Real u2, Vector& out, Color& weight) const {
+    Vector wo = -i->ray.direction.normalized();
+    Vector n = i->normal;
+    if (n.dot(wo) < 0) n = -n;
+
+    // Orthonormal frame around the normal
+    Vector helper = (fabs(n.x()) > 0.9)? Vector(0,1,0) : Vector(1,0,0);
+    Vector t = n.cross(helper).normalized();
+    Vector b = n.cross(t);
+
+    Real alpha = std::max(roughness * roughness, (Real) 0.001);
+    Real alpha2 = alpha * alpha;
+
+    Real nDotO = n.dot(wo);
+    if (nDotO <= 0) return false;
+
+    // Pick a microfacet normal among those visible from wo (Heitz 2018):
+    // stretch the view to a unit roughness hemisphere, sample the disk it
+    // projects to, then unstretch
+    Vector vh = Vector(alpha * wo.dot(t), alpha * wo.dot(b), nDotO).normalized();
+    Real lenSq = vh.x() * vh.x() + vh.y() * vh.y();
+    Vector t1 = (lenSq > 0)? Vector(Vector(-vh.y(), vh.x(), 0) / sqrt(lenSq)) : Vector(1,0,0);
+    Vector t2 = vh.cross(t1);
+
+    Real r = sqrt(u1);
+    Real phi = 2 * M_PI * u2;
+    Real p1 = r * cos(phi);
+    Real p2 = r * sin(phi);
+    Real s = (1 + vh.z()) / 2;
+    p2 = (1 - s) * sqrt(1 - p1 * p1) + s * p2;
+
+    Vector nh = p1 * t1 + p2 * t2 + sqrt(std::max((Real) 0, 1 - p1 * p1 - p2 * p2)) * vh;
+    Vector local = Vector(alpha * nh.x(), alpha * nh.y(), std::max((Real) 0, nh.z())).normalized();
+    Vector h = local.x() * t + local.y() * b + local.z() * n;
+
+    Real oDotH = wo.dot(h);
+    if (oDotH <= 0) return false;
+
+    out = 2 * oDotH * h - wo;
+
+    Real nDotI = n.dot(out);
+    if (nDotI <= 0) return false;
+
+    // D and the masking of wo cancel against the pdf, leaving F * G1(i)
+    Color fresnel = f0 + (Color(1,1,1) - f0) * pow(1 - oDotH, 5);
+    weight = fresnel * smithG1(alpha2, nDotI);
+
+    return true;
+}
+
+Color GGXGlossy::getColor(const Intersection *i, const Scene *scene) const {
+    int bouncesLeft;
+
+    if (i->bouncesLeft == -1) {
+        bouncesLeft = maxBounces;
+    } else if (i->bouncesLeft == 0){
+        return Color(0,0,0);
+    } else {
+        bouncesLeft = (i->bouncesLeft - 1);
+    }
+
+    minstd_rand rng = rngFromPosition(i->getPosition());
+
+    Color f0 = color->getColor(i, scene);
+    Color sum(0,0,0);
+
+    int samples = (splitOnlyFirstBounce && i->bouncesLeft != -1)? 1 : numSamples;
+
+    for (int s = 0; s < samples; ++s) {
+        Vector dir;
+        Color weight;
+        Real u1 = uniform(rng);
+        if (!sampleDirection(i, f0, u1, uniform(rng), dir, weight)) continue;
+
+        Intersection reflSample(Ray(i->getPosition(), dir));
+        reflSample.bouncesLeft = bouncesLeft;
+        RayContext samplePath;
+        if (!i->spawn(reflSample, samplePath, weight / samples)) continue;
+
+        scene->intersect(reflSample);
+        sum += reflSample.getColor(scene).cwiseProduct(weight);
+    }
+
+    return sum / samples;
+}
+
+void GGXGlossy::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    Vector dir;
+    Color weight;
+    Real u1 = (Real) rand() / RAND_MAX;
+    Real u2 = (Real) rand() / RAND_MAX;
+    if (!sampleDirection(i, color->getColor(i, scene), u1, u2, dir, weight)) return;
+
+    v.continues = true;
+    v.next = Ray(i->getPosition(), dir);
+    v.weight = weight;
 }
 
 
 // ============== Glass =================
 
-Color Glass::getColor(const Intersection *i, const Scene *scene) const {
+Vector Glass::refract(const Intersection *i) const {
     // Get ray in and normal vector, then calculate refraction
     Vector in = (i->ray).direction.normalized();
     Vector n = i->normal;
@@ -212,9 +373,12 @@ Color Glass::getColor(const Intersection *i, const Scene *scene) const {
         out = outPerp + outPara;
     }
 
-    Ray rayOut(i->getPosition(), out);
+    return out;
+}
+
+Color Glass::getColor(const Intersection *i, const Scene *scene) const {
+    Ray rayOut(i->getPosition(), refract(i));
     Intersection refrInter(rayOut);
-    if(i->DEBUG) refrInter.DEBUG = true;
 
     if (i->bouncesLeft == -1) {
         refrInter.bouncesLeft = maxBounces;
@@ -225,10 +389,20 @@ Color Glass::getColor(const Intersection *i, const Scene *scene) const {
         refrInter.bouncesLeft = (i->bouncesLeft - 1);
     }
 
+    Color tint = color->getColor(i, scene);
+    RayContext refrPath;
+    if (!i->spawn(refrInter, refrPath, tint)) return Color(0,0,0);
+
     if (i->DEBUG) printf("recursing...");
-    scene->shapes.intersect(refrInter);
+    scene->intersect(refrInter);
+
+    return refrInter.getColor(scene).cwiseProduct(tint);
+}
 
-    return refrInter.getColor(scene).cwiseProduct(color->getColor(i, scene));
+void Glass::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    v.continues = true;
+    v.next = Ray(i->getPosition(), refract(i));
+    v.weight = color->getColor(i, scene);
 }
 
 
@@ -280,6 +454,8 @@ Color Skybox::getColor(const Intersection* i, const Scene* scene) const {
         origin = bot_origin;
     }
 
+    if (si.intersected) si.shape->resolveSurface(si);
+
     texCoords = origin + (Vec2(si.u, si.v).cwiseProduct(Vec2(1.0/8, 1.0/6)));
 
     return texture->at(texCoords[0], texCoords[1]);
@@ -324,25 +500,88 @@ Color Add::getColor(const Intersection* i, const Scene* scene) const {
     return sum;
 }
 
+void Add::sample(const Intersection* i, const Scene* scene, PathVertex& v) const {
+    // Gather direct light from every component, but only follow one of the
+    // continuations, picked in proportion to its weight. Each one replaces
+    // the kept one with the chance of its share of the weight so far, which
+    // picks every one in proportion without keeping them all around.
+    PathVertex part, picked;
+    Real totalWeight = 0;
+    for (size_t x = 0; x < components.size(); ++x) {
+        part = PathVertex();
+        components[x]->sample(i, scene, part);
+        v.direct += part.direct;
+
+        Real weight = part.weight.mean();
+        if (!part.continues || weight <= 0) continue;
+        totalWeight += weight;
+        if ((Real) rand() / (RAND_MAX + 1.0) * totalWeight < weight) picked = part;
+    }
+
+    if (totalWeight <= 0) return;
+
+    v.continues = true;
+    v.next = picked.next;
+    v.weight = picked.weight * (totalWeight / picked.weight.mean());
+}
+
 
 // ======== Mix ========
 
-Color Mix::getColor(const Intersection *i, const Scene *scene) const {
-    Color facColor = (factorMat->getColor(i, scene)).cwiseProduct(Color(factor, factor, factor)) + Color(bias, bias, bias);
+bool Mix::stochasticByDefault = false;
 
+Color Mix::getFactor(const Intersection *i, const Scene *scene) const {
+    return (factorMat->getColor(i, scene)).cwiseProduct(Color(factor, factor, factor)) + Color(bias, bias, bias);
+}
+
+Color Mix::getColor(const Intersection *i, const Scene *scene) const {
+    Color facColor = getFactor(i, scene);
 
     if ((facColor[0] >= 1) && (facColor[1] >= 1) && (facColor[2] >= 1)) {
         return (matA == nullptr)? Color(0,0,0) : matA->getColor(i, scene);
     } else if ((facColor[0] <= 0) && (facColor[1] <= 0) && (facColor[2] <= 0)) {
         return (matB == nullptr)? Color(0,0,0) : matB->getColor(i, scene);
+    } else if (mode == MIX_STOCHASTIC || (mode == MIX_DEFAULT && stochasticByDefault)) {
+        // Trace only one side, so nested mixes cost one path rather than a tree
+        Color scale;
+        const Material *picked = pickA(facColor, scale)? matA : matB;
+        return (picked == nullptr)? Color(0,0,0) : picked->getColor(i, scene).cwiseProduct(scale);
     } else {
         Color factorInv = Color(1,1,1) - facColor;
-        Color a = (matA == nullptr)? Color(0,0,0) : matA->getColor(i, scene);
-        Color b = (matB == nullptr)? Color(0,0,0) : matB->getColor(i, scene);
+
+        // Let each side know how much it can still contribute
+        RayContext path(*i->context);
+        Intersection weighted(*i);
+        weighted.context = &path;
+        path.throughput = i->context->throughput.cwiseProduct(facColor);
+        Color a = (matA == nullptr)? Color(0,0,0) : matA->getColor(&weighted, scene);
+        path.throughput = i->context->throughput.cwiseProduct(factorInv);
+        Color b = (matB == nullptr)? Color(0,0,0) : matB->getColor(&weighted, scene);
         return facColor.cwiseProduct(a) + factorInv.cwiseProduct(b);
     }
 }
 
+bool Mix::pickA(const Color& facColor, Color& scale) const {
+    Color clamped = facColor.cwiseMax(0).cwiseMin(1);
+    Real p = clamped.mean();
+
+    if (p >= 1 || (Real) rand() / RAND_MAX < p) {
+        scale = clamped / p;
+        return true;
+    }
+    scale = (Color(1,1,1) - clamped) / (1 - p);
+    return false;
+}
+
+void Mix::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    Color scale;
+    const Material *picked = pickA(getFactor(i, scene), scale)? matA : matB;
+    if (picked == nullptr) return;
+
+    picked->sample(i, scene, v);
+    v.scale(scale);
+}
+
 
 // =========== Multiply ==============
 
@@ -350,6 +589,26 @@ Color Multiply::getColor(const Intersection *i, const Scene *scene) const {
     return this->matA->getColor(i, scene).cwiseProduct(this->matB->getColor(i, scene));
 }
 
+void Multiply::sample(const Intersection *i, const Scene *scene, PathVertex& v) const {
+    PathVertex a, b;
+    matA->sample(i, scene, a);
+    matB->sample(i, scene, b);
+
+    // Usually one side is a plain color scaling the other
+    if (!b.continues) {
+        v = a;
+        v.scale(b.direct);
+    } else if (!a.continues) {
+        v = b;
+        v.scale(a.direct);
+    } else {
+        // The product of two traced sides has no single continuation with
+        // the right expectation, so it is traced out in full
+        v = PathVertex();
+        v.direct = getColor(i, scene);
+    }
+}
+
 // =========== ConstMix =============
 
 ConstMix::ConstMix(Material *matA, Material *matB, Real factor) {
@@ -371,6 +630,10 @@ Color ConstMix::getColor(const Intersection* i, const Scene* scene) const {
     return mixer->getColor(i, scene);
 }
 
+void ConstMix::sample(const Intersection* i, const Scene* scene, PathVertex& v) const {
+    mixer->sample(i, scene, v);
+}
+
 
 // ====================== TESTING MATERIALS ==============================
 
@@ -3,6 +3,7 @@
 
 #include "SETTINGS.hpp"
 #include "color.hpp"
+#include "ray.hpp"
 
 class Intersection;
 class Scene;
@@ -14,9 +15,28 @@ class ConstMix;
 
 using namespace std;
 
+// One step along a path traced by PathTracer: the light gathered at a hit
+// without tracing any further, plus at most one ray to continue along.
+struct PathVertex {
+    Color direct;
+    bool continues;
+    Ray next;
+    Color weight; // Throughput of next, already divided by the chance of picking it
+
+    PathVertex(): direct(0,0,0), continues(false), weight(0,0,0) {}
+
+    void scale(const Color& c) {
+        direct = direct.cwiseProduct(c);
+        weight = weight.cwiseProduct(c);
+    }
+};
+
 class Material {
 public:
     virtual Color getColor(const Intersection* i, const Scene* scene) const = 0;
+    // Pick a single continuation for a path instead of recursing. Materials
+    // that don't trace rays just report their color as direct light.
+    virtual void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
     virtual ~Material() {};
     Add operator +( const Material& other );
     Multiply operator *( const Material& other );
@@ -59,6 +79,7 @@ public:
     Mirror(Material *color, int maxBounces): color(color), maxBounces(maxBounces) {};
     ~Mirror() {};
     Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
 };
 
 class Glossy: public Material {
@@ -67,9 +88,38 @@ public:
     int maxBounces;
     int numSamples;
     Real roughness;
+    // Trace one ray instead of numSamples past the first bounce, so nested
+    // glossy surfaces don't multiply the ray count
+    bool splitOnlyFirstBounce = false;
     Glossy(Material *color, int maxBounces, int numSamples, Real roughness): color(color), maxBounces(maxBounces), numSamples(numSamples), roughness(roughness) {};
     ~Glossy() {};
     Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
+private:
+    // Offset r along the tangents by two uniform numbers in [0, 1)
+    Vector perturb(const Intersection* i, const Vector& r, Real u1, Real u2) const;
+};
+
+// Microfacet glossy reflection with a GGX distribution. Reflection
+// directions are importance sampled from the distribution of visible
+// normals, so few samples are wasted. Unlike Glossy, by default numSamples
+// rays are only split off at the first bounce; deeper bounces trace one ray.
+class GGXGlossy: public Material {
+public:
+    Material *color; // Reflectance at normal incidence
+    int maxBounces;
+    int numSamples;
+    Real roughness;  // 0 is a perfect mirror, 1 is very rough
+    bool splitOnlyFirstBounce = true;
+    GGXGlossy(Material *color, int maxBounces, int numSamples, Real roughness): color(color), maxBounces(maxBounces), numSamples(numSamples), roughness(roughness) {};
+    ~GGXGlossy() {};
+    Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
+private:
+    // Sample a reflected direction from two uniform numbers in [0, 1).
+    // Returns false if it went below the surface, otherwise the weight is
+    // BRDF * cos / pdf for that direction.
+    bool sampleDirection(const Intersection* i, const Color& f0, Real u1, Real u2, Vector& out, Color& weight) const;
 };
 
 class Glass: public Material {
@@ -80,6 +130,9 @@ public:
     Glass(Material *color, Real ior, int maxBounces): color(color), ior(ior), maxBounces(maxBounces) {};
     ~Glass() {};
     Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
+private:
+    Vector refract(const Intersection* i) const;
 };
 
 class Skybox: public Material {
@@ -97,6 +150,14 @@ public:
     void addComponent(const Material * material);
     ~Add();
     Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
+};
+
+// How a Mix with a fractional factor evaluates its two materials
+enum MixMode {
+    MIX_DEFAULT,    // Whatever Mix::stochasticByDefault says
+    MIX_BOTH,       // Evaluate both and blend
+    MIX_STOCHASTIC  // Evaluate one, picked by its weight, and rescale
 };
 
 class Mix: public Material {
@@ -106,13 +167,24 @@ private:
     const Material *factorMat;
     Real factor;
     Real bias;
+
+    Color getFactor(const Intersection* i, const Scene* scene) const;
+    // Randomly pick A or B by their mean weights. scale is what the picked
+    // material must be multiplied by to keep the expected result.
+    bool pickA(const Color& facColor, Color& scale) const;
 public:
+    MixMode mode = MIX_DEFAULT;
+    // Mode for every Mix left at MIX_DEFAULT
+    static bool stochasticByDefault;
+
     Mix(const Material *matA, const Material *matB, const Material *factorMat)
         : matA(matA), matB(matB), factorMat(factorMat), factor(1), bias(0) {};
     Mix(const Material *matA, const Material *matB, const Material *factorMat, Real factor, Real bias)
         : matA(matA), matB(matB), factorMat(factorMat), factor(factor), bias(bias) {};
     ~Mix() {};
     Color getColor(const Intersection* i, const Scene* scene) const;
+    // Follows one of the two materials, picked by the mix factor
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
 };
 
 class Multiply: public Material {
@@ -122,6 +194,9 @@ public:
     Multiply(const Material *matA, const Material *matB): matA(matA), matB(matB) {};
     ~Multiply() {};
     Color getColor(const Intersection* i, const Scene* scene) const;
+    // Follows whichever side continues, scaled by the other. When both
+    // continue, their product is evaluated with getColor instead.
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
 };
 
 class ConstMix: public Material {
@@ -133,7 +208,9 @@ public:
     ConstMix(Material *matA, Material *matB, Real factor);
     ConstMix(Material *matA, Material *matB, Color factor);
     ~ConstMix();
+    void setMixMode(MixMode mode) { mixer->mode = mode; }
     Color getColor(const Intersection* i, const Scene* scene) const;
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const;
 
 };
 
@@ -195,10 +272,16 @@ public:
         // Mix mat
         mixer(Mix(&mirror, &glass, &ref)) {};
 
+    void setMixMode(MixMode mode) { mixer.mode = mode; }
+
     Color getColor(const Intersection* i, const Scene* scene) const {
         return mixer.getColor(i, scene);
     }
 
+    void sample(const Intersection* i, const Scene* scene, PathVertex& v) const {
+        mixer.sample(i, scene, v);
+    }
+
 };
 
 // ===========================================================================
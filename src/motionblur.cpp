@@ -0,0 +1,147 @@
+#include "motionblur.hpp"
+
+// ==================== MotionBlur ======================
+
+MotionBlur::MotionBlur(Shape* shape, Real shutter): shape(shape), shutter(shutter) {
+    this->material = shape->material;
+    this->origin = shape->origin;
+    setMotion(Affine3D::Identity());
+}
+
+void MotionBlur::follow(Animation* animation) {
+    animations.push_back(animation);
+}
+
+void MotionBlur::setMotion(const Affine3D& motion) {
+    frameMotion = motion;
+
+    AngleAxis3D rotation(motion.linear());
+    Vector t = motion.translation();
+
+    if (fabs(rotation.angle()) < 1e-9) {
+        // Just sliding
+        angle = 0;
+        slide = t.norm();
+        axis = (slide > 0)? Vector(t / slide) : Vector(0,0,1);
+        center = Point(0,0,0);
+    } else {
+        // Chasles: any rigid motion turns about some axis and slides along
+        // it. The axis runs through center, where the sideways part of the
+        // translation is undone by the turn.
+        axis = rotation.axis();
+        angle = rotation.angle();
+        slide = t.dot(axis);
+        Vector side = t - slide * axis;
+        center = (side + axis.cross(side) / tan(angle / 2)) / 2;
+    }
+
+    moving = angle != 0 || slide != 0;
+    updateBoundingBox();
+}
+
+bool MotionBlur::setFrame(int frame) {
+    Affine3D motion = Affine3D::Identity();
+    for (size_t a = 0; a < animations.size(); ++a) {
+        Affine3D step;
+        if (animations[a]->getMotion(frame, step)) motion = step * motion;
+    }
+
+    if (motion.matrix() == frameMotion.matrix()) return false;
+    setMotion(motion);
+    return true;
+}
+
+Affine3D MotionBlur::motionAt(Real time) const {
+    Affine3D motion = Affine3D::Identity();
+    motion.translate(center + time * slide * axis);
+    motion.rotate(AngleAxis3D(time * angle, axis));
+    motion.translate(-center);
+    return motion;
+}
+
+// The ray as the unmoved shape sees it. The motion is rigid, so distances
+// along it stay the same.
+Ray MotionBlur::toShape(const Ray& ray) const {
+    Affine3D back = motionAt(ray.time).inverse(Eigen::Isometry);
+    return Ray(back * ray.origin, back.linear() * ray.direction, ray.time);
+}
+
+bool MotionBlur::intersect(Intersection& i) const {
+    if (!moving) return shape->intersect(i);
+
+    Ray ray = i.ray;
+    i.ray = toShape(ray);
+    bool hit = shape->intersect(i);
+    i.ray = ray;
+    return hit;
+}
+
+bool MotionBlur::shadowIntersect(Intersection& i) const {
+    if (!moving) return shape->shadowIntersect(i);
+
+    Ray ray = i.ray;
+    i.ray = toShape(ray);
+    bool hit = shape->shadowIntersect(i);
+    i.ray = ray;
+    return hit;
+}
+
+// The hit keeps what intersect found inside (shape, primitive, t), so its
+// surface is resolved where the shape was at the ray's time and turned
+// back with it
+bool MotionBlur::resolveSurface(Intersection& i) const {
+    if (!moving) return shape->resolveSurface(i);
+
+    Intersection local(i);
+    local.ray = toShape(i.ray);
+    if (!shape->resolveSurface(local)) return false;
+
+    Affine3D motion = motionAt(i.ray.time);
+    i.u = local.u;
+    i.v = local.v;
+    i.normal = motion.linear() * local.normal;
+    i.tangent = motion.linear() * local.tangent;
+    i.bitangent = motion.linear() * local.bitangent;
+    return true;
+}
+
+void MotionBlur::translate(const Vector& t) {
+    shape->translate(t);
+    origin = shape->origin;
+}
+
+void MotionBlur::rotate(const Vector& axis, const Real angle) {
+    shape->rotate(axis, angle);
+}
+
+void MotionBlur::setMaterial(Material* mat) {
+    shape->setMaterial(mat);
+    this->material = mat;
+}
+
+AABB MotionBlur::getBoundingBox() const {
+    shape->updateBoundingBox();
+    AABB box = shape->getBoundingBox();
+    if (!moving) return box;
+
+    // Each corner of the box at steps along the shutter. Between steps a
+    // corner follows an arc, which bulges out from its chord by at most
+    // half the chord times tan of a quarter of the angle turned.
+    Point corners[8];
+    for (int c = 0; c < 8; ++c) corners[c] = box.corner((AABB::CornerType) c);
+
+    AABB swept = box;
+    Real bulge = 0;
+    for (int s = 1; s <= MOTION_BLUR_STEPS; ++s) {
+        Affine3D motion = motionAt(shutter * s / MOTION_BLUR_STEPS);
+        for (int c = 0; c < 8; ++c) {
+            Point p = motion * box.corner((AABB::CornerType) c);
+            bulge = std::max(bulge, (p - corners[c]).norm() / 2);
+            corners[c] = p;
+            swept.extend(p);
+        }
+    }
+    bulge *= tan(fabs(shutter * angle) / MOTION_BLUR_STEPS / 4);
+
+    return AABB(swept.min() - Vector(bulge, bulge, bulge), swept.max() + Vector(bulge, bulge, bulge));
+}
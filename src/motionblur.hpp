@@ -0,0 +1,61 @@
+#ifndef MOTIONBLUR_H
+#define MOTIONBLUR_H
+
+#include <vector>
+
+#include "SETTINGS.hpp"
+#include "shape.hpp"
+#include "animation.hpp"
+
+// Steps the swept bounds are sampled at over the shutter
+#define MOTION_BLUR_STEPS 8
+
+// Blurs a shape along the way its animations move it, by placing it for
+// each ray where it is at the ray's time (see Camera::shutter). Only rigid
+// motion is followed (Translator, Rotator and TurnTable), taken over each
+// frame as a single screw: turning about one axis while sliding along it.
+//
+// Add it to the Animator after the animations it follows, so it sees where
+// they put the shape each frame.
+class MotionBlur: public Shape, public Animation {
+private:
+    Shape *shape;
+    Real shutter;
+    vector<Animation*> animations;
+
+    Affine3D frameMotion; // From this frame to the next
+    bool moving;
+
+    // Motion over the shutter as a screw through center
+    Point center;
+    Vector axis;
+    Real angle, slide;
+
+    // Where the shape is moved to at time, within the shutter
+    Affine3D motionAt(Real time) const;
+    Ray toShape(const Ray& ray) const;
+
+public:
+    // shutter should match the camera's
+    MotionBlur(Shape* shape, Real shutter);
+    ~MotionBlur() {};
+
+    void follow(Animation* animation);
+    // The motion over a whole frame, normally set from the animations followed
+    void setMotion(const Affine3D& motion);
+    bool setFrame(int frame);
+
+    bool intersect(Intersection& i) const;
+    bool shadowIntersect(Intersection& i) const;
+    // Hits are left on the shape inside, so they're shaded with its own
+    // material
+    bool resolveSurface(Intersection& i) const;
+    void translate(const Vector& t);
+    using Shape::rotate;
+    void rotate(const Vector& axis, const Real angle);
+    void setMaterial(Material* mat);
+    // Swept over the shutter
+    AABB getBoundingBox() const;
+};
+
+#endif
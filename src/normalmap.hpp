@@ -14,30 +14,41 @@ private:
 
 public:
     NormalMap(Shape *baseShape, Material *map, Scene *scene, Real factor = 1): baseShape(baseShape), map(map), scene(scene), factor(factor) {};
+    // The map is only looked up once this turns out to be the closest hit,
+    // see resolveSurface
     bool intersect(Intersection& i) const {
-        if(baseShape->intersect(i)) {
-            // Subtract 0.5 to allow for negative and positive offset
-            if(i.DEBUG) PRINT("GETTING OFFSET");
-            Vector offset = map->getColor(&i, scene) - Vector(0.5, 0.5, 0.5);
-            if(i.DEBUG) PRINTV3(offset);
-            // Bring back to full range
-            offset *= 2 * factor;
-
-            Vector worldSpaceOffset = offset[0] * i.tangent +
-                                      offset[1] * i.bitangent +
-                                      offset[2] * i.normal;
-
-            if(i.DEBUG) PRINTV3(worldSpaceOffset);
-
-            i.normal += worldSpaceOffset;
-            i.normal.normalize();
-
-            if(i.DEBUG) PRINTV3(i.normal);
-            return true;
-        }
-        return false;
+        return baseShape->intersect(i);
     };
 
+    // Occlusion doesn't care about the normal
+    bool shadowIntersect(Intersection& i) const {
+        if (castShadows) return baseShape->intersect(i);
+        return false;
+    }
+
+    bool resolveSurface(Intersection& i) const {
+        if (!baseShape->resolveSurface(i)) return false;
+
+        // Subtract 0.5 to allow for negative and positive offset
+        if(i.DEBUG) PRINT("GETTING OFFSET");
+        Vector offset = map->getColor(&i, scene) - Vector(0.5, 0.5, 0.5);
+        if(i.DEBUG) PRINTV3(offset);
+        // Bring back to full range
+        offset *= 2 * factor;
+
+        Vector worldSpaceOffset = offset[0] * i.tangent +
+                                  offset[1] * i.bitangent +
+                                  offset[2] * i.normal;
+
+        if(i.DEBUG) PRINTV3(worldSpaceOffset);
+
+        i.normal += worldSpaceOffset;
+        i.normal.normalize();
+
+        if(i.DEBUG) PRINTV3(i.normal);
+        return true;
+    }
+
     void translate(const Vector& t) {
         baseShape->translate(t);
     }
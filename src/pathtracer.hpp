@@ -0,0 +1,102 @@
+#ifndef PATHTRACER_H
+#define PATHTRACER_H
+
+#include "SETTINGS.hpp"
+#include "shape.hpp"
+#include "image.hpp"
+#include "camera.hpp"
+#include "scene.hpp"
+
+// Bounces before Russian roulette may end a path, and a hard cap after it
+#define PATH_RR_MIN_DEPTH 3
+#define PATH_MAX_DEPTH 64
+
+// Alternative to RayTracer that follows a single path per sample instead of
+// letting materials recurse into every branch. Each hit picks one
+// continuation (see Material::sample), and paths whose throughput gets low
+// are ended by Russian roulette, so a sample costs time linear in its depth.
+class PathTracer {
+public:
+    // Radiance along a camera ray. depth gets the t of the first hit, or -1.
+    static Color tracePath(const Ray& cameraRay, const Scene* scene, Real& depth) {
+        Color radiance(0,0,0);
+        Color throughput(1,1,1);
+        Ray ray = cameraRay;
+        depth = -1;
+
+        for (int bounce = 0; bounce < PATH_MAX_DEPTH; ++bounce) {
+            Intersection i(ray);
+            scene->intersect(i);
+
+            if (!i.intersected) {
+                radiance += throughput.cwiseProduct(i.getColor(scene));
+                break;
+            }
+
+            if (bounce == 0) depth = i.t;
+
+            PathVertex v;
+            i.shape->material->sample(&i, scene, v);
+            radiance += throughput.cwiseProduct(v.direct);
+
+            if (!v.continues) break;
+            throughput = throughput.cwiseProduct(v.weight);
+
+            // Russian roulette: keep the path with a chance that follows its
+            // throughput, and boost the survivors to stay unbiased
+            if (bounce + 1 >= PATH_RR_MIN_DEPTH) {
+                Real survive = std::min(throughput.maxCoeff(), (Real) 0.95);
+                if ((Real) rand() / RAND_MAX >= survive) break;
+                throughput /= survive;
+            }
+
+            ray = v.next;
+            ray.time = cameraRay.time;
+        }
+
+        return radiance;
+    }
+
+    static void pathTrace(Image& image, Image& depthMap, Camera* camera, Scene* scene, bool status = false) {
+        for (int x = 0; x < image.getWidth(); x++) {
+            if (status) fprintf(stderr, "\rProgress: %.1f%%", ((float) x / image.getWidth()) * 100);
+            for (int y = 0; y < image.getHeight(); y++) {
+                Vec2 screenCoords((float) x / image.getWidth(), (float) y / image.getHeight());
+
+                Color c_sum(0,0,0);
+                Real d_sum = 0;
+
+                for (int i = 0; i < camera->samplesPerPixel; ++i) {
+                    Ray ray = camera->makeRay(screenCoords);
+                    ray.time = camera->sampleTime(i);
+                    Real depth;
+
+                    c_sum += tracePath(ray, scene, depth);
+
+                    if (depth >= 0) {
+                        d_sum += depth;
+                    } else {
+                        d_sum = -camera->samplesPerPixel;
+                    }
+                }
+
+                Color *curPixel = image.at(x, y);
+                *curPixel = c_sum / camera->samplesPerPixel;
+
+                Color *curDepth = depthMap.at(x, y);
+                Real depth = (d_sum / camera->samplesPerPixel);
+                *curDepth = Color(depth, depth, depth);
+            }
+        }
+
+        Color max = depthMap.getMaxColor();
+        for (int i = 0; i < depthMap.getWidth() * depthMap.getHeight(); ++i) {
+            if (*depthMap.at(i) == Color(-1,-1,-1)){
+                *depthMap.at(i) = max;
+            }
+        }
+
+    }
+};
+
+#endif
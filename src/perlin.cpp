@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <map>
+#include <mutex>
+#include <random>
 
 #include "perlin.hpp"
 
@@ -24,18 +27,14 @@
     r0 = t - (int)t;\
     r1 = r0 - 1.0f;
 
-Real Perlin::noise1(Real arg) {
+Real Perlin::noise1(Real arg) const {
+    const int* p = tables->p;
+    const Real* g1 = tables->g1;
     int bx0, bx1;
     Real rx0, rx1, sx, t, u, v, vec[1];
 
     vec[0] = arg;
 
-    if (start) {
-        srand(seed);
-        start = false;
-        init();
-    }
-
     setup(0, bx0,bx1, rx0,rx1);
 
     sx = s_curve(rx0);
@@ -46,17 +45,14 @@ Real Perlin::noise1(Real arg) {
     return lerp(sx, u, v);
 }
 
-Real Perlin::noise2(Real vec[2]) {
+Real Perlin::noise2(Real vec[2]) const {
+    const int* p = tables->p;
+    const Real (*g2)[2] = tables->g2;
     int bx0, bx1, by0, by1, b00, b10, b01, b11;
-    Real rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
+    Real rx0, rx1, ry0, ry1, sx, sy, a, b, t, u, v;
+    const Real *q;
     int i, j;
 
-    if (start) {
-        srand(seed);
-        start = false;
-        init();
-    }
-
     setup(0,bx0,bx1,rx0,rx1);
     setup(1,by0,by1,ry0,ry1);
 
@@ -88,17 +84,14 @@ Real Perlin::noise2(Real vec[2]) {
     return lerp(sy, a, b);
 }
 
-Real Perlin::noise3(Real vec[3]) {
+Real Perlin::noise3(Real vec[3]) const {
+    const int* p = tables->p;
+    const Real (*g3)[3] = tables->g3;
     int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
-    Real rx0, rx1, ry0, ry1, rz0, rz1, *q, sy, sz, a, b, c, d, t, u, v;
+    Real rx0, rx1, ry0, ry1, rz0, rz1, sy, sz, a, b, c, d, t, u, v;
+    const Real *q;
     int i, j;
 
-    if (start) {
-        srand(seed);
-        start = false;
-        init();
-    }
-
     setup(0, bx0,bx1, rx0,rx1);
     setup(1, by0,by1, ry0,ry1);
     setup(2, bz0,bz1, rz0,rz1);
@@ -140,7 +133,186 @@ Real Perlin::noise3(Real vec[3]) {
     return lerp(sz, c, d);
 }
 
-void Perlin::normalize2(Real v[2]) {
+// ==================== Batched noise ======================
+// Each lane step is split into index setup, gradient gathers into SoA arrays
+// and a branch-free blend, so the arithmetic passes vectorise across lanes.
+
+#define LANES PERLIN_LANES
+
+void Perlin::noise2Lanes(const Real x[LANES], const Real y[LANES], Real out[LANES]) const {
+    const int* p = tables->p;
+    const Real (*g2)[2] = tables->g2;
+
+    int bx0[LANES], bx1[LANES], by0[LANES], by1[LANES];
+    Real rx0[LANES], rx1[LANES], ry0[LANES], ry1[LANES];
+
+    for (int l = 0; l < LANES; ++l) {
+        Real tx = x[l] + N, ty = y[l] + N;
+        bx0[l] = ((int)tx) & BM;
+        bx1[l] = (bx0[l]+1) & BM;
+        rx0[l] = tx - (int)tx;
+        rx1[l] = rx0[l] - 1.0f;
+        by0[l] = ((int)ty) & BM;
+        by1[l] = (by0[l]+1) & BM;
+        ry0[l] = ty - (int)ty;
+        ry1[l] = ry0[l] - 1.0f;
+    }
+
+    // Gradients for the four corners: 00, 10, 01, 11
+    Real gx[4][LANES], gy[4][LANES];
+    for (int l = 0; l < LANES; ++l) {
+        int i = p[bx0[l]];
+        int j = p[bx1[l]];
+        int corner[4] = { p[i + by0[l]], p[j + by0[l]], p[i + by1[l]], p[j + by1[l]] };
+        for (int c = 0; c < 4; ++c) {
+            gx[c][l] = g2[corner[c]][0];
+            gy[c][l] = g2[corner[c]][1];
+        }
+    }
+
+    for (int l = 0; l < LANES; ++l) {
+        Real sx = s_curve(rx0[l]);
+        Real sy = s_curve(ry0[l]);
+
+        Real u = rx0[l] * gx[0][l] + ry0[l] * gy[0][l];
+        Real v = rx1[l] * gx[1][l] + ry0[l] * gy[1][l];
+        Real a = lerp(sx, u, v);
+
+        u = rx0[l] * gx[2][l] + ry1[l] * gy[2][l];
+        v = rx1[l] * gx[3][l] + ry1[l] * gy[3][l];
+        Real b = lerp(sx, u, v);
+
+        out[l] = lerp(sy, a, b);
+    }
+}
+
+void Perlin::noise3Lanes(const Real x[LANES], const Real y[LANES], const Real z[LANES], Real out[LANES]) const {
+    const int* p = tables->p;
+    const Real (*g3)[3] = tables->g3;
+
+    int bx0[LANES], bx1[LANES], by0[LANES], by1[LANES], bz0[LANES], bz1[LANES];
+    Real rx0[LANES], rx1[LANES], ry0[LANES], ry1[LANES], rz0[LANES], rz1[LANES];
+
+    for (int l = 0; l < LANES; ++l) {
+        Real tx = x[l] + N, ty = y[l] + N, tz = z[l] + N;
+        bx0[l] = ((int)tx) & BM;
+        bx1[l] = (bx0[l]+1) & BM;
+        rx0[l] = tx - (int)tx;
+        rx1[l] = rx0[l] - 1.0f;
+        by0[l] = ((int)ty) & BM;
+        by1[l] = (by0[l]+1) & BM;
+        ry0[l] = ty - (int)ty;
+        ry1[l] = ry0[l] - 1.0f;
+        bz0[l] = ((int)tz) & BM;
+        bz1[l] = (bz0[l]+1) & BM;
+        rz0[l] = tz - (int)tz;
+        rz1[l] = rz0[l] - 1.0f;
+    }
+
+    // Gradients for the eight corners: 000, 100, 010, 110, 001, 101, 011, 111
+    Real gx[8][LANES], gy[8][LANES], gz[8][LANES];
+    for (int l = 0; l < LANES; ++l) {
+        int i = p[bx0[l]];
+        int j = p[bx1[l]];
+        int b00 = p[i + by0[l]], b10 = p[j + by0[l]], b01 = p[i + by1[l]], b11 = p[j + by1[l]];
+        int corner[8] = { b00 + bz0[l], b10 + bz0[l], b01 + bz0[l], b11 + bz0[l],
+                          b00 + bz1[l], b10 + bz1[l], b01 + bz1[l], b11 + bz1[l] };
+        for (int c = 0; c < 8; ++c) {
+            gx[c][l] = g3[corner[c]][0];
+            gy[c][l] = g3[corner[c]][1];
+            gz[c][l] = g3[corner[c]][2];
+        }
+    }
+
+    for (int l = 0; l < LANES; ++l) {
+        Real t  = s_curve(rx0[l]);
+        Real sy = s_curve(ry0[l]);
+        Real sz = s_curve(rz0[l]);
+
+        Real u = rx0[l] * gx[0][l] + ry0[l] * gy[0][l] + rz0[l] * gz[0][l];
+        Real v = rx1[l] * gx[1][l] + ry0[l] * gy[1][l] + rz0[l] * gz[1][l];
+        Real a = lerp(t, u, v);
+        u = rx0[l] * gx[2][l] + ry1[l] * gy[2][l] + rz0[l] * gz[2][l];
+        v = rx1[l] * gx[3][l] + ry1[l] * gy[3][l] + rz0[l] * gz[3][l];
+        Real b = lerp(t, u, v);
+        Real c = lerp(sy, a, b);
+
+        u = rx0[l] * gx[4][l] + ry0[l] * gy[4][l] + rz1[l] * gz[4][l];
+        v = rx1[l] * gx[5][l] + ry0[l] * gy[5][l] + rz1[l] * gz[5][l];
+        a = lerp(t, u, v);
+        u = rx0[l] * gx[6][l] + ry1[l] * gy[6][l] + rz1[l] * gz[6][l];
+        v = rx1[l] * gx[7][l] + ry1[l] * gy[7][l] + rz1[l] * gz[7][l];
+        b = lerp(t, u, v);
+        Real d = lerp(sy, a, b);
+
+        out[l] = lerp(sz, c, d);
+    }
+}
+
+void Perlin::get2Batch(const Real* x, const Real* y, Real* out, int n) const {
+    for (int start = 0; start < n; start += LANES) {
+        Real vx[LANES], vy[LANES], noise[LANES], result[LANES];
+
+        // Pad a short tail with the last lookup
+        for (int l = 0; l < LANES; ++l) {
+            int k = std::min(start + l, n - 1);
+            vx[l] = x[k] * frequency;
+            vy[l] = y[k] * frequency;
+            result[l] = 0;
+        }
+
+        Real localAmp = amplitude;
+        for (int o = 0; o < octaves; ++o) {
+            noise2Lanes(vx, vy, noise);
+            for (int l = 0; l < LANES; ++l) {
+                result[l] += noise[l] * localAmp;
+                vx[l] *= 2;
+                vy[l] *= 2;
+            }
+            localAmp *= persistence;
+        }
+
+        for (int l = 0; l < LANES && start + l < n; ++l) {
+            out[start + l] = result[l];
+        }
+    }
+}
+
+void Perlin::getBatch(const Real* x, const Real* y, const Real* z, Real* out, int n) const {
+    for (int start = 0; start < n; start += LANES) {
+        Real vx[LANES], vy[LANES], vz[LANES], noise[LANES], result[LANES];
+
+        // Pad a short tail with the last lookup. As in fullNoise3D, z is not
+        // scaled by the base frequency.
+        for (int l = 0; l < LANES; ++l) {
+            int k = std::min(start + l, n - 1);
+            vx[l] = x[k] * frequency;
+            vy[l] = y[k] * frequency;
+            vz[l] = z[k];
+            result[l] = 0;
+        }
+
+        Real localAmp = amplitude;
+        for (int o = 0; o < octaves; ++o) {
+            noise3Lanes(vx, vy, vz, noise);
+            for (int l = 0; l < LANES; ++l) {
+                result[l] += noise[l] * localAmp;
+                vx[l] *= 2;
+                vy[l] *= 2;
+                vz[l] *= 2;
+            }
+            localAmp *= persistence;
+        }
+
+        for (int l = 0; l < LANES && start + l < n; ++l) {
+            out[start + l] = result[l];
+        }
+    }
+}
+
+// ==================== Tables ======================
+
+static void normalize2(Real v[2]) {
     Real s;
 
     s = (Real)sqrt(v[0] * v[0] + v[1] * v[1]);
@@ -149,7 +321,7 @@ void Perlin::normalize2(Real v[2]) {
     v[1] = v[1] * s;
 }
 
-void Perlin::normalize3(Real v[3]) {
+static void normalize3(Real v[3]) {
     Real s;
 
     s = (Real)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
@@ -160,23 +332,26 @@ void Perlin::normalize3(Real v[3]) {
     v[2] = v[2] * s;
 }
 
-void Perlin::init(void) {
+// Uses a private generator rather than srand/rand so building tables never
+// disturbs the global RNG the samplers rely on.
+PerlinTables::PerlinTables(int seed) {
     int i, j, k;
+    std::mt19937 rng(seed);
 
     for (i = 0 ; i < B ; i++) {
         p[i] = i;
-        g1[i] = (Real)((rand() % (B + B)) - B) / B;
+        g1[i] = (Real)((int)(rng() % (B + B)) - B) / B;
         for (j = 0 ; j < 2 ; j++)
-            g2[i][j] = (Real)((rand() % (B + B)) - B) / B;
+            g2[i][j] = (Real)((int)(rng() % (B + B)) - B) / B;
         normalize2(g2[i]);
         for (j = 0 ; j < 3 ; j++)
-            g3[i][j] = (Real)((rand() % (B + B)) - B) / B;
+            g3[i][j] = (Real)((int)(rng() % (B + B)) - B) / B;
         normalize3(g3[i]);
     }
 
     while (--i) {
         k = p[i];
-        p[i] = p[j = rand() % B];
+        p[i] = p[j = rng() % B];
         p[j] = k;
     }
 
@@ -191,8 +366,18 @@ void Perlin::init(void) {
 
 }
 
+std::shared_ptr<const PerlinTables> PerlinTables::forSeed(int seed) {
+    static std::mutex cacheMutex;
+    static std::map<int, std::shared_ptr<const PerlinTables>> cache;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::shared_ptr<const PerlinTables>& tables = cache[seed];
+    if (!tables) tables = std::make_shared<const PerlinTables>(seed);
+    return tables;
+}
+
 
-Real Perlin::fullNoise2D(Real vec[2]) {
+Real Perlin::fullNoise2D(Real vec[2]) const {
     Real result = 0;
     Real localAmp = amplitude;
 
@@ -210,7 +395,7 @@ Real Perlin::fullNoise2D(Real vec[2]) {
 }
 
 
-Real Perlin::fullNoise3D(Real vec[3]) {
+Real Perlin::fullNoise3D(Real vec[3]) const {
     Real result = 0;
     Real localAmp = amplitude;
 
@@ -3,17 +3,35 @@
 
 #include "SETTINGS.hpp"
 #include <stdlib.h>
+#include <memory>
 
 #define SAMPLE_SIZE 1024
+#define PERLIN_LANES 4
+
+// Gradient and permutation tables for one seed. They are built once, never
+// modified afterwards and shared by every Perlin using the same seed, so
+// noise can be evaluated from any number of threads.
+struct PerlinTables
+{
+  int p[SAMPLE_SIZE + SAMPLE_SIZE + 2];
+  Real g3[SAMPLE_SIZE + SAMPLE_SIZE + 2][3];
+  Real g2[SAMPLE_SIZE + SAMPLE_SIZE + 2][2];
+  Real g1[SAMPLE_SIZE + SAMPLE_SIZE + 2];
+
+  PerlinTables(int seed);
+
+  static std::shared_ptr<const PerlinTables> forSeed(int seed);
+};
 
 class Perlin
 {
 public:
 
   Perlin(int octaves = 1, Real frequency = 1, Real amplitude = 1, Real persistence = 0.5, int seed=12345)
-      : octaves(octaves), frequency(frequency), amplitude(amplitude), seed(seed), start(true) {}
+      : octaves(octaves), frequency(frequency), amplitude(amplitude), persistence(persistence), seed(seed),
+        tables(PerlinTables::forSeed(seed)) {}
 
-  Real get(Real x, Real y, Real z)
+  Real get(Real x, Real y, Real z) const
   {
     Real vec[3];
     vec[0] = x;
@@ -22,7 +40,7 @@ public:
     return fullNoise3D(vec);
   };
 
-  Real get2(Real x, Real y)
+  Real get2(Real x, Real y) const
   {
     Real vec[2];
     vec[0] = x;
@@ -30,16 +48,18 @@ public:
     return fullNoise2D(vec);
   };
 
+  // Evaluate n lookups at once, PERLIN_LANES at a time across all octaves
+  void getBatch(const Real* x, const Real* y, const Real* z, Real* out, int n) const;
+  void get2Batch(const Real* x, const Real* y, Real* out, int n) const;
+
 private:
-  void init_perlin(int n,Real p);
-  Real fullNoise2D(Real vec[2]);
-  Real fullNoise3D(Real vec[3]);
-  Real noise1(Real arg);
-  Real noise2(Real vec[2]);
-  Real noise3(Real vec[3]);
-  void normalize2(Real v[2]);
-  void normalize3(Real v[3]);
-  void init(void);
+  Real fullNoise2D(Real vec[2]) const;
+  Real fullNoise3D(Real vec[3]) const;
+  Real noise1(Real arg) const;
+  Real noise2(Real vec[2]) const;
+  Real noise3(Real vec[3]) const;
+  void noise2Lanes(const Real x[PERLIN_LANES], const Real y[PERLIN_LANES], Real out[PERLIN_LANES]) const;
+  void noise3Lanes(const Real x[PERLIN_LANES], const Real y[PERLIN_LANES], const Real z[PERLIN_LANES], Real out[PERLIN_LANES]) const;
 
   int octaves;
   Real frequency;
@@ -47,11 +67,7 @@ private:
   Real persistence;
   int seed;
 
-  int p[SAMPLE_SIZE + SAMPLE_SIZE + 2];
-  Real g3[SAMPLE_SIZE + SAMPLE_SIZE + 2][3];
-  Real g2[SAMPLE_SIZE + SAMPLE_SIZE + 2][2];
-  Real g1[SAMPLE_SIZE + SAMPLE_SIZE + 2];
-  bool start;
+  std::shared_ptr<const PerlinTables> tables;
 
 };
 
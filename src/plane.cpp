@@ -60,15 +60,18 @@ bool Plane::intersect(Intersection &intersection) const {
     intersection.t = t;
     intersection.intersected = true;
     intersection.shape = this;
-    intersection.normal = normal;
 
-    // Copy over UV coords
-    intersection.u = hitU;
-    intersection.v = hitV;
+    return true;
+}
+
+void Plane::computeSurface(Intersection &intersection) const {
+    Point localPos = intersection.getPosition() - origin;
+
+    intersection.normal = normal;
+    intersection.u = localPos.dot(u);
+    intersection.v = localPos.dot(v);
     intersection.tangent = u;
     intersection.bitangent = v;
-
-    return true;
 }
 
 AABB Plane::getBoundingBox() const {
@@ -12,6 +12,7 @@ public:
     Plane(const Point& point, const Vector& normal, Real width, Real height, const Vector& u, Material *material, bool center=false);
     ~Plane() {};
     bool intersect(Intersection &intersection) const;
+    void computeSurface(Intersection &intersection) const;
     using Shape::rotate;
     void translate(const Vector& t);
     void rotate(const Vector& axis, const Real angle);
@@ -1,9 +1,9 @@
 #include "ray.hpp"
 
-Ray::Ray() : origin(Point(0,0,0)), direction(Vector(0,0,0)) {}
+Ray::Ray() : origin(Point(0,0,0)), direction(Vector(0,0,0)), time(0) {}
 
-Ray::Ray(const Point origin, const Vector direction):
-  origin(origin), direction(direction.normalized()) {}
+Ray::Ray(const Point origin, const Vector direction, Real time):
+  origin(origin), direction(direction.normalized()), time(time) {}
 
 Ray::~Ray(){}
 
@@ -8,12 +8,11 @@
 class Ray {
 public:
   Point origin;
-  Point o = origin;
   Vector direction;
-  Vector dir = direction;
+  Real time; // Frames since the current one started, see Camera::shutter
 
   Ray();
-  Ray(const Point origin, const Vector direction);
+  Ray(const Point origin, const Vector direction, Real time = 0);
   ~Ray();
 
   Point at(Real t) const;
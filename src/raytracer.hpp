@@ -10,21 +10,50 @@
 class RayTracer {
 public:
     static void rayTrace(Image& image, Image& depthMap, Camera* camera, Scene* scene, bool status = false) {
+        TemporalCache *temporal = scene->temporal;
+
         for (int x = 0; x < image.getWidth(); x++) {
             if (status) fprintf(stderr, "\rProgress: %.1f%%", ((float) x / image.getWidth()) * 100);
             for (int y = 0; y < image.getHeight(); y++) {
+                // Nothing this pixel depends on changed since the last frame
+                if (temporal != NULL && !temporal->isDirty(x, y)) {
+                    Real depth = temporal->getDepth(x, y);
+                    *image.at(x, y) = temporal->getColor(x, y);
+                    *depthMap.at(x, y) = Color(depth, depth, depth);
+                    temporal->reused++;
+                    continue;
+                }
+
+                PixelDeps *deps = (temporal != NULL)? temporal->beginPixel(x, y) : NULL;
+
                 Vec2 screenCoords((float) x / image.getWidth(), (float) y / image.getHeight());
 
                 Color c_sum(0,0,0);
                 Real d_sum = 0;
 
+                // Split the pixel's budget over its samples, passing on what
+                // earlier samples didn't use
+                RayBudget budget = { 0 };
+                int budgetLeft = camera->rayBudget;
+
                 for (int i = 0; i < camera->samplesPerPixel; ++i) {
                     Ray ray = camera->makeRay(screenCoords);
-                    Vector dir = ray.direction;
+                    ray.time = camera->sampleTime(i);
+                    RayContext path;
+                    path.deps = deps;
                     Intersection intersection(ray);
+                    intersection.context = &path;
+
+                    if (camera->rayBudget > 0) {
+                        int share = budgetLeft / (camera->samplesPerPixel - i);
+                        budget.raysLeft = share;
+                        budgetLeft -= share;
+                        path.budget = &budget;
+                    }
 
-                    scene->shapes.intersect(intersection);
+                    scene->intersect(intersection);
                     c_sum += intersection.getColor(scene);
+                    budgetLeft += budget.raysLeft;
 
                     if (intersection.intersected) {
                         d_sum += intersection.t;
@@ -39,6 +68,8 @@ public:
                 Color *curDepth = depthMap.at(x, y);
                 Real depth = (d_sum / camera->samplesPerPixel);
                 *curDepth = Color(depth, depth, depth);
+
+                if (temporal != NULL) temporal->store(x, y, *curPixel, depth);
             }
         }
 
@@ -4,6 +4,8 @@
 #include "shape.hpp"
 #include "material.hpp"
 #include "texture.hpp"
+#include "irradiancecache.hpp"
+#include "temporalcache.hpp"
 
 class Scene {
 public:
@@ -11,15 +13,51 @@ public:
         shapes = ShapeGroup();
         lights = LightGroup();
         this->material = material;
+        this->irradiance = NULL;
+        this->temporal = NULL;
     };
     ~Scene() {};
     ShapeGroup shapes;
     LightGroup lights;
     Material *material;
+    IrradianceCache *irradiance; // Indirect light for Diffuse, off when NULL
+    TemporalCache *temporal;     // Pixel reuse between frames, off when NULL
+
+    // Closest hit for a shading ray, with its surface fully resolved
+    bool intersect(Intersection& i) const {
+        bool hit = shapes.intersect(i);
+        if (hit) shapes.resolveSurface(i);
+
+        PixelDeps *deps = i.context->deps;
+        if (deps != NULL && temporal != NULL) {
+            temporal->recordRay(i.ray, hit? i.t : REAL_MAX, *deps);
+            temporal->recordMaterial(hit? i.shape->material : material, *deps);
+        }
+        return hit;
+    }
+
+    // Shadow ray for the point from is shading, reaching tMax along
+    bool shadowIntersect(Intersection& shadow, const Intersection& from, Real tMax) const {
+        shadow.ray.time = from.ray.time;
+        bool hit = shapes.shadowIntersect(shadow);
+        PixelDeps *deps = from.context->deps;
+        if (deps != NULL && temporal != NULL) temporal->recordRay(shadow.ray, tMax, *deps);
+        return hit;
+    }
+
+    // Lights to shade a hit with (see LightGroup::select)
+    int selectLights(const Intersection& i, LightSample* out) const {
+        int count = lights.select(i.getPosition(), out);
+        PixelDeps *deps = i.context->deps;
+        if (deps != NULL && temporal != NULL) {
+            for (int x = 0; x < count; ++x) temporal->recordLight(out[x].light, *deps);
+        }
+        return count;
+    }
 
     vector<Material *> previzMats;
     void makePreviz() {
-        for (int i = 0; i < shapes.members.size(); ++i) {
+        for (size_t i = 0; i < shapes.members.size(); ++i) {
             SolidColor *c = new SolidColor((Real) rand() / RAND_MAX, (Real) rand() / RAND_MAX, (Real) rand() / RAND_MAX);
             shapes[i]->setMaterial(c);
             previzMats.push_back(c);
@@ -27,7 +65,7 @@ public:
     }
 
     void freePreviz() {
-        for (int i = 0; i < previzMats.size(); ++i) {
+        for (size_t i = 0; i < previzMats.size(); ++i) {
             delete previzMats[i];
         }
     }
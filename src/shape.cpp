@@ -1,6 +1,7 @@
 #include "shape.hpp"
 #include "SETTINGS.hpp"
 #include "material.hpp"
+#include "light.hpp"
 
 // ==================== SHAPEGROUP ======================
 
@@ -46,6 +47,13 @@ bool ShapeGroup::shadowIntersect(Intersection& i) const {
     return hit;
 }
 
+bool ShapeGroup::resolveSurface(Intersection& i) const {
+    for (size_t x = 0; x < members.size(); ++x) {
+        if (members[x]->resolveSurface(i)) return true;
+    }
+    return false;
+}
+
 void ShapeGroup::translate(const Vector &t) {
     for (int x = 0; x < members.size(); ++x) {
         members[x]->translate(t);
@@ -103,4 +111,54 @@ LightGroup::LightGroup() {
 
 void LightGroup::addLight(Light *light) {
     members.push_back(light);
+    update();
+}
+
+void LightGroup::update() {
+    globalLights.clear();
+    localLights.clear();
+    for (size_t x = 0; x < members.size(); ++x) {
+        if (members[x]->isLocal()) {
+            localLights.push_back(members[x]);
+        } else {
+            globalLights.push_back(members[x]);
+        }
+    }
+
+    tree.build(localLights);
+}
+
+int LightGroup::select(const Point& p, LightSample* out) const {
+    int count = 0;
+    int globals = globalLights.size();
+    int room = globalRoom();
+    if (globals == room) {
+        for (int x = 0; x < globals; ++x) {
+            out[count++] = { globalLights[x], 1 };
+        }
+    } else {
+        // One light from each of room even slices of the global lights
+        for (int s = 0; s < room; ++s) {
+            int begin = s * globals / room;
+            int end = (s + 1) * globals / room;
+            int pick = begin + (int) ((end - begin) * ((Real) rand() / ((Real) RAND_MAX + 1)));
+            out[count++] = { globalLights[pick], (Real) (end - begin) };
+        }
+    }
+
+    if ((int) localLights.size() <= localRoom(maxLocalLights)) {
+        for (size_t x = 0; x < localLights.size(); ++x) {
+            out[count++] = { localLights[x], 1 };
+        }
+        return count;
+    }
+
+    int samples = localRoom(lightSamples);
+    for (int s = 0; s < samples; ++s) {
+        Real u = (Real) rand() / ((Real) RAND_MAX + 1);
+        Real pdf;
+        Light *light = tree.sample(p, u, pdf);
+        out[count++] = { light, 1 / (pdf * samples) };
+    }
+    return count;
 }
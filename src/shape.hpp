@@ -7,7 +7,10 @@
 #include "material.hpp"
 #include <cmath>
 #include <algorithm>
+#include <new>
+#include <utility>
 #include "animation.hpp"
+#include "lighttree.hpp"
 
 class Light;
 
@@ -73,6 +76,17 @@ public:
         if (castShadows) return intersect(i);
         return false;
     }
+    // Fill in normal, UVs and tangent frame for a hit on this shape. Only t,
+    // shape and primitive are set by intersect().
+    virtual void computeSurface(Intersection& i) const {}
+    // Compute the surface for the closest hit of a shading ray if it's on
+    // this shape or inside it. Shapes that wrap others pass it down and
+    // adjust what comes back (see NormalMap). False if the hit is elsewhere.
+    virtual bool resolveSurface(Intersection& i) const {
+        if (i.shape != this) return false;
+        computeSurface(i);
+        return true;
+    }
     ShapeGroup operator +(Shape& other);
     Material *material;
     Point origin; //LCS origin
@@ -94,19 +108,87 @@ public:
     void rotate(const Vector& axis, const Real angle);
     virtual bool intersect(Intersection& i) const;
     virtual bool shadowIntersect(Intersection& i) const;
+    virtual bool resolveSurface(Intersection& i) const;
     virtual void setMaterial(Material* mat);
     virtual Shape* operator [](size_t i) const;
     AABB getBoundingBox() const;
     vector<Shape*> members;
 };
 
+// Shapes per block of a ShapePool
+#define SHAPE_POOL_BLOCK 64
+
+// Owns many shapes of one type, made side by side in blocks of
+// SHAPE_POOL_BLOCK rather than one allocation each. Shapes never move once
+// made, so pointers to them (e.g. in a ShapeGroup) stay good until the pool
+// goes away, and then they all go with it.
+template <typename T>
+class ShapePool {
+private:
+    vector<T*> blocks;
+    int used = SHAPE_POOL_BLOCK; // Shapes made in the last block
+
+public:
+    ShapePool() {};
+    ShapePool(const ShapePool& other) = delete;
+
+    ~ShapePool() {
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            int count = (b + 1 == blocks.size())? used : SHAPE_POOL_BLOCK;
+            for (int s = 0; s < count; ++s) blocks[b][s].~T();
+            ::operator delete(blocks[b]);
+        }
+    }
+
+    template <typename... Args>
+    T* make(Args&&... args) {
+        if (used == SHAPE_POOL_BLOCK) {
+            blocks.push_back((T*) ::operator new(SHAPE_POOL_BLOCK * sizeof(T)));
+            used = 0;
+        }
+        T* shape = new (blocks.back() + used) T(std::forward<Args>(args)...);
+        ++used;
+        return shape;
+    }
+
+    size_t size() const {
+        return blocks.empty()? 0 : (blocks.size() - 1) * SHAPE_POOL_BLOCK + used;
+    }
+};
+
+// Most lights LightGroup::select hands back for one point
+#define MAX_SHADING_LIGHTS 16
+
 // A group of only lights
 class LightGroup {
+private:
+    vector<Light*> globalLights; // Lights without a position, always evaluated
+    vector<Light*> localLights;
+    LightTree tree;
+    // Global lights select hands back, one place is always left for local lights
+    int globalRoom() const {
+        return std::min((int) globalLights.size(), MAX_SHADING_LIGHTS - (localLights.empty()? 0 : 1));
+    }
+    // At most n, less if the global lights leave less room in select, but at least one
+    int localRoom(int n) const { return std::max(1, std::min(n, MAX_SHADING_LIGHTS - globalRoom())); }
 public:
     LightGroup();
     ~LightGroup() {};
     void addLight(Light* light);
+    // Rebuild light selection, call after lights have moved
+    void update();
+    // Lights to shade p with, into out, which has room for
+    // MAX_SHADING_LIGHTS. Returns how many there are. Once there are more
+    // than maxLocalLights local lights, lightSamples of them are picked from
+    // the light tree instead of using them all. Global lights that don't fit
+    // are picked from too.
+    int select(const Point& p, LightSample* out) const;
+    bool isSampled() const {
+        return (int) localLights.size() > localRoom(maxLocalLights) || (int) globalLights.size() > globalRoom();
+    }
     vector<Light*> members;
+    int maxLocalLights = 8; // Both are capped by MAX_SHADING_LIGHTS
+    int lightSamples = 4;
 };
 
 
@@ -0,0 +1,531 @@
+#include "skeletonshape.hpp"
+#include "loader.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// ==================== SkeletonShape ======================
+
+SkeletonShape::SkeletonShape(string skeletonFilename, string motionFilename, Material* material,
+    int initialFrame, Vector axes, Vector origin, Real radius)
+    : axes(axes), radius(radius)
+{
+    this->material = material;
+    this->origin = base = origin;
+    placement = toPose = Affine3D::Identity();
+    placed = false;
+
+    Skeleton* skeleton = new Skeleton(skeletonFilename.c_str(), MOCAP_SCALE);
+    skeleton->setBasePosture();
+    load(skeleton, new Motion(motionFilename.c_str(), MOCAP_SCALE, skeleton), initialFrame);
+}
+
+SkeletonShape::SkeletonShape(Skeleton* skeleton, Motion* motion, Material* material,
+    int initialFrame, Vector axes, Vector origin, Real radius)
+    : axes(axes), radius(radius)
+{
+    this->material = material;
+    this->origin = base = origin;
+    placement = toPose = Affine3D::Identity();
+    placed = false;
+
+    load(skeleton, motion, initialFrame);
+}
+
+SkeletonShape::~SkeletonShape() {
+    delete displayer; // And with it the skeleton and motion
+}
+
+void SkeletonShape::load(Skeleton* skeleton, Motion* motion, int initialFrame) {
+    this->skeleton = skeleton;
+    this->motion = motion;
+
+    displayer = new DisplaySkeleton();
+    displayer->LoadSkeleton(skeleton);
+    displayer->LoadMotion(motion);
+
+    // Bones and the joints they share come from the hierarchy, bone i
+    // running from its parent's joint to joint i
+    int numBones = skeleton->numBonesInSkel(*skeleton->getRoot());
+    transforms.resize(MAX_BONES_IN_ASF_FILE);
+    bones.assign(numBones, Segment());
+    findBones(skeleton->getRoot()->child, 0);
+
+    // Consecutive bones in depth first order mostly follow a limb, so each
+    // packet stays compact
+    live.joints.assign(numBones, Point(0,0,0));
+    live.packets.resize((order.size() + CAPSULE_PACKET - 1) / CAPSULE_PACKET);
+
+    curFrameTime = frameTime = initialFrame;
+    poseJoints(frameTime, &transforms[0], live.joints.data());
+    fillPackets(live.joints.data(), live.packets.data());
+
+    // The tree is laid out over the first pose and only refit afterwards
+    vector<int> packetIndices;
+    for (size_t p = 0; p < live.packets.size(); ++p) packetIndices.push_back(p);
+    nodes.clear();
+    if (!live.packets.empty()) {
+        nodes.reserve(2 * live.packets.size() - 1);
+        build(packetIndices, 0, packetIndices.size());
+    }
+
+    live.boxes.resize(nodes.size());
+    refit(live.joints.data(), live.packets.data(), live.boxes.data());
+    show(live, 0);
+
+    Shape::updateBoundingBox();
+}
+
+void SkeletonShape::findBones(Bone* bone, int parent) {
+    for (; bone != NULL; bone = bone->sibling) {
+        bones[bone->idx].start = parent;
+        bones[bone->idx].end = bone->idx;
+        order.push_back(bone->idx);
+        findBones(bone->child, bone->idx);
+    }
+}
+
+void SkeletonShape::pose() {
+    poseInto(frameTime, &transforms[0], live.joints.data(), live.packets.data(), live.boxes.data());
+    show(live, 0);
+}
+
+void SkeletonShape::show(PoseBuffer& buffer, int slot) {
+    joints = buffer.joints.data() + slot * bones.size();
+    packets = buffer.packets.data() + slot * live.packets.size();
+    boxes = buffer.boxes.data() + slot * nodes.size();
+}
+
+// Copy a baked pose over the live one before changing it
+void SkeletonShape::makeLive() {
+    if (joints == live.joints.data()) return;
+
+    copy(joints, joints + bones.size(), live.joints.begin());
+    copy(packets, packets + live.packets.size(), live.packets.begin());
+    copy(boxes, boxes + nodes.size(), live.boxes.begin());
+    show(live, 0);
+}
+
+void SkeletonShape::poseJoints(Real time, Affine3D* transforms, Point* joints) const {
+    int frame = (int) floor(time);
+    Real t = time - frame;
+    if (t > 0 && frame + 1 < motion->GetNumFrames()) {
+        DisplaySkeleton::ComputeBoneTransforms(skeleton, motion->GetPostureView(frame), motion->GetPostureView(frame + 1), t, transforms);
+    } else {
+        DisplaySkeleton::ComputeBoneTransforms(skeleton, motion->GetPostureView(frame), transforms);
+    }
+
+    // Bones off the root start where the root is
+    joints[0] = transforms[0].translation().cwiseProduct(axes) + base;
+    for (size_t b = 0; b < order.size(); ++b) {
+        int i = order[b];
+        Point end = transforms[i] * Vector(0, 0, skeleton->getBone(i).length);
+        joints[i] = end.cwiseProduct(axes) + base;
+    }
+}
+
+void SkeletonShape::poseInto(Real time, Affine3D* transforms, Point* joints, CapsulePacket* packets, Box* boxes) const {
+    poseJoints(time, transforms, joints);
+    fillPackets(joints, packets);
+    refit(joints, packets, boxes);
+}
+
+void SkeletonShape::fillPackets(const Point* joints, CapsulePacket* packets) const {
+    size_t numPackets = live.packets.size();
+    for (size_t p = 0; p < numPackets; ++p) {
+        CapsulePacket& packet = packets[p];
+        for (int lane = 0; lane < CAPSULE_PACKET; ++lane) {
+            size_t o = p * CAPSULE_PACKET + lane;
+            packet.bone[lane] = (o < order.size())? order[o] : -1;
+
+            // Unused lanes repeat the first bone, which wins any tie
+            int b = (o < order.size())? order[o] : order[p * CAPSULE_PACKET];
+
+            const Point& a = joints[bones[b].start];
+            const Point& e = joints[bones[b].end];
+            packet.ax[lane] = a[0]; packet.ay[lane] = a[1]; packet.az[lane] = a[2];
+            packet.bx[lane] = e[0]; packet.by[lane] = e[1]; packet.bz[lane] = e[2];
+            packet.r[lane] = radius;
+        }
+    }
+}
+
+void SkeletonShape::precompute(const vector<Real>& times, int numThreads) {
+    // The shape may be showing a pose about to be replaced
+    makeLive();
+
+    // Each time once, clamped like updatePosition does
+    vector<Real> unique;
+    bakedSlots.clear();
+    for (size_t f = 0; f < times.size(); ++f) {
+        Real time = std::max((Real) 0, std::min((Real) (motion->GetNumFrames() - 1), times[f]));
+        if (bakedSlots.count(time)) continue;
+        bakedSlots[time] = unique.size();
+        unique.push_back(time);
+    }
+
+    size_t numJoints = bones.size(), numPackets = live.packets.size(), numBoxes = nodes.size();
+    baked.joints.assign(unique.size() * numJoints, Point(0,0,0));
+    baked.packets.resize(unique.size() * numPackets);
+    baked.boxes.resize(unique.size() * numBoxes);
+
+    // Each thread takes a contiguous run of poses
+    ThreadPool pool(numThreads);
+    int chunks = pool.size();
+    vector<shared_future<bool>> done;
+    for (int c = 0; c < chunks; ++c) {
+        size_t start = unique.size() * c / chunks, end = unique.size() * (c + 1) / chunks;
+        done.push_back(pool.submit<bool>([this, &unique, start, end, numJoints, numPackets, numBoxes]() {
+            vector<Affine3D> transforms(MAX_BONES_IN_ASF_FILE);
+            for (size_t s = start; s < end; ++s) {
+                poseInto(unique[s], &transforms[0], baked.joints.data() + s * numJoints,
+                         baked.packets.data() + s * numPackets, baked.boxes.data() + s * numBoxes);
+            }
+            return true;
+        }));
+    }
+    for (size_t c = 0; c < done.size(); ++c) {
+        done[c].get();
+    }
+}
+
+void SkeletonShape::precompute(const ValueAnimator<Real>& driver, int startFrame, int stopFrame, int step, int numThreads) {
+    vector<Real> times;
+    for (int f = startFrame; f <= stopFrame; f += step) {
+        times.push_back(driver.valueAt(f));
+    }
+    precompute(times, numThreads);
+}
+
+// Like AABB::doesIntersect, but also skipping boxes past tMax. tNear is
+// where the ray enters the box.
+bool SkeletonShape::hitsNode(const Box& box, const Ray& ray, Real tMax, Real& tNear) {
+    Real tmin = -INFINITY, tmax = tMax;
+
+    for (int a = 0; a < 3; ++a) {
+        if (ray.direction[a] != 0.0) {
+            Real t1 = (box.min[a] - ray.origin[a]) / ray.direction[a];
+            Real t2 = (box.max[a] - ray.origin[a]) / ray.direction[a];
+
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        } else if (ray.origin[a] <= box.min[a] || ray.origin[a] >= box.max[a]) {
+            return false;
+        }
+    }
+
+    tNear = tmin;
+    return tmax >= tmin && tmax > 0.0;
+}
+
+int SkeletonShape::build(vector<int>& packetIndices, int start, int end) {
+    int index = nodes.size();
+    nodes.resize(index + 1);
+
+    if (end - start == 1) {
+        Node& leaf = nodes[index];
+        leaf.left = leaf.right = -1;
+        leaf.packet = packetIndices[start];
+        return index;
+    }
+
+    // Split at the median along the widest axis of the packet centers
+    vector<Point> centers(live.packets.size());
+    Vec3 cmin(REAL_MAX, REAL_MAX, REAL_MAX), cmax(-REAL_MAX, -REAL_MAX, -REAL_MAX);
+    for (int p = start; p < end; ++p) {
+        const CapsulePacket& packet = live.packets[packetIndices[p]];
+        Point center(0,0,0);
+        int count = 0;
+        for (int lane = 0; lane < CAPSULE_PACKET; ++lane) {
+            if (packet.bone[lane] < 0) continue;
+            center += Point(packet.ax[lane] + packet.bx[lane], packet.ay[lane] + packet.by[lane], packet.az[lane] + packet.bz[lane]) / 2;
+            ++count;
+        }
+        centers[packetIndices[p]] = center / count;
+        cmin = cmin.cwiseMin(centers[packetIndices[p]]);
+        cmax = cmax.cwiseMax(centers[packetIndices[p]]);
+    }
+
+    int axis;
+    (cmax - cmin).maxCoeff(&axis);
+
+    int mid = (start + end) / 2;
+    nth_element(packetIndices.begin() + start, packetIndices.begin() + mid, packetIndices.begin() + end,
+                [&centers, axis](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+    int left = build(packetIndices, start, mid);
+    int right = build(packetIndices, mid, end);
+
+    // nodes may have reallocated, so only take the reference now
+    Node& node = nodes[index];
+    node.left = left;
+    node.right = right;
+    node.packet = -1;
+
+    return index;
+}
+
+void SkeletonShape::refit(const Point* joints, const CapsulePacket* packets, Box* boxes) const {
+    // Children always come after their parent
+    for (int n = nodes.size() - 1; n >= 0; --n) {
+        const Node& node = nodes[n];
+        Box& box = boxes[n];
+        if (node.left >= 0) {
+            box.min = boxes[node.left].min.cwiseMin(boxes[node.right].min);
+            box.max = boxes[node.left].max.cwiseMax(boxes[node.right].max);
+            continue;
+        }
+
+        const CapsulePacket& packet = packets[node.packet];
+        box.min = Vec3(REAL_MAX, REAL_MAX, REAL_MAX);
+        box.max = Vec3(-REAL_MAX, -REAL_MAX, -REAL_MAX);
+        for (int lane = 0; lane < CAPSULE_PACKET; ++lane) {
+            int b = packet.bone[lane];
+            if (b < 0) continue;
+            const Point& a = joints[bones[b].start];
+            const Point& e = joints[bones[b].end];
+            box.min = box.min.cwiseMin(a.cwiseMin(e) - Vec3(radius, radius, radius));
+            box.max = box.max.cwiseMax(a.cwiseMax(e) + Vec3(radius, radius, radius));
+        }
+    }
+}
+
+void SkeletonShape::updatePosition() {
+    // Clamp frameTime
+    if (frameTime < 0) frameTime = 0;
+    if (frameTime > motion->GetNumFrames() - 1) frameTime = motion->GetNumFrames() - 1;
+
+    if (frameTime == curFrameTime) return;
+    curFrameTime = frameTime;
+
+    // Baked poses are only swapped in
+    map<Real, int>::const_iterator slot = bakedSlots.find(frameTime);
+    if (slot != bakedSlots.end()) {
+        show(baked, slot->second);
+    } else {
+        pose();
+    }
+    Shape::updateBoundingBox();
+}
+
+// Rays against capsules after Inigo Quilez: the infinite cylinder first,
+// then whichever cap sphere the hit falls past. Each lane tests one bone.
+int SkeletonShape::intersectPacket(const CapsulePacket& packet, const float o[3], const float d[3], float tMin, float tMax, float& t) const {
+#ifdef __SSE2__
+    __m128 ox = _mm_set1_ps(o[0]), oy = _mm_set1_ps(o[1]), oz = _mm_set1_ps(o[2]);
+    __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+    __m128 ax = _mm_loadu_ps(packet.ax), ay = _mm_loadu_ps(packet.ay), az = _mm_loadu_ps(packet.az);
+    __m128 r = _mm_loadu_ps(packet.r);
+    __m128 zero = _mm_setzero_ps();
+    __m128 tLow = _mm_set1_ps(tMin);
+
+    // ba = b - a, oa = o - a
+    __m128 bax = _mm_sub_ps(_mm_loadu_ps(packet.bx), ax);
+    __m128 bay = _mm_sub_ps(_mm_loadu_ps(packet.by), ay);
+    __m128 baz = _mm_sub_ps(_mm_loadu_ps(packet.bz), az);
+    __m128 oax = _mm_sub_ps(ox, ax), oay = _mm_sub_ps(oy, ay), oaz = _mm_sub_ps(oz, az);
+
+    __m128 baba = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bax, bax), _mm_mul_ps(bay, bay)), _mm_mul_ps(baz, baz));
+    __m128 bard = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bax, dx), _mm_mul_ps(bay, dy)), _mm_mul_ps(baz, dz));
+    __m128 baoa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bax, oax), _mm_mul_ps(bay, oay)), _mm_mul_ps(baz, oaz));
+    __m128 rdoa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, oax), _mm_mul_ps(dy, oay)), _mm_mul_ps(dz, oaz));
+    __m128 oaoa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(oax, oax), _mm_mul_ps(oay, oay)), _mm_mul_ps(oaz, oaz));
+    __m128 rr = _mm_mul_ps(r, r);
+
+    // Body
+    __m128 qa = _mm_sub_ps(baba, _mm_mul_ps(bard, bard));
+    __m128 qb = _mm_sub_ps(_mm_mul_ps(baba, rdoa), _mm_mul_ps(baoa, bard));
+    __m128 qc = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(baba, oaoa), _mm_mul_ps(baoa, baoa)), _mm_mul_ps(rr, baba));
+    __m128 h = _mm_sub_ps(_mm_mul_ps(qb, qb), _mm_mul_ps(qa, qc));
+    __m128 hit = _mm_cmpge_ps(h, zero);
+    __m128 sq = _mm_sqrt_ps(_mm_max_ps(h, zero));
+
+    __m128 tBody = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, qb), sq), qa);
+    __m128 y = _mm_add_ps(baoa, _mm_mul_ps(tBody, bard));
+    __m128 onBody = _mm_and_ps(_mm_cmpgt_ps(y, zero), _mm_cmplt_ps(y, baba));
+    onBody = _mm_and_ps(onBody, _mm_cmpgt_ps(tBody, tLow));
+
+    // Caps, at a when the body hit falls before it, otherwise at b
+    __m128 atStart = _mm_cmple_ps(y, zero);
+    __m128 cx = _mm_or_ps(_mm_and_ps(atStart, oax), _mm_andnot_ps(atStart, _mm_sub_ps(oax, bax)));
+    __m128 cy = _mm_or_ps(_mm_and_ps(atStart, oay), _mm_andnot_ps(atStart, _mm_sub_ps(oay, bay)));
+    __m128 cz = _mm_or_ps(_mm_and_ps(atStart, oaz), _mm_andnot_ps(atStart, _mm_sub_ps(oaz, baz)));
+    __m128 cb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, cx), _mm_mul_ps(dy, cy)), _mm_mul_ps(dz, cz));
+    __m128 cc = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)), rr);
+    __m128 ch = _mm_sub_ps(_mm_mul_ps(cb, cb), cc);
+    __m128 tCap = _mm_sub_ps(_mm_sub_ps(zero, cb), _mm_sqrt_ps(_mm_max_ps(ch, zero)));
+    __m128 onCap = _mm_and_ps(_mm_cmpgt_ps(ch, zero), _mm_cmpgt_ps(tCap, tLow));
+
+    __m128 tHit = _mm_or_ps(_mm_and_ps(onBody, tBody), _mm_andnot_ps(onBody, tCap));
+    hit = _mm_and_ps(hit, _mm_or_ps(onBody, onCap));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(tHit, _mm_set1_ps(tMax)));
+
+    int mask = _mm_movemask_ps(hit);
+    if (mask == 0) return -1;
+
+    float ts[CAPSULE_PACKET];
+    _mm_storeu_ps(ts, tHit);
+#else
+    float ts[CAPSULE_PACKET];
+    int mask = 0;
+    for (int lane = 0; lane < CAPSULE_PACKET; ++lane) {
+        float bax = packet.bx[lane] - packet.ax[lane], bay = packet.by[lane] - packet.ay[lane], baz = packet.bz[lane] - packet.az[lane];
+        float oax = o[0] - packet.ax[lane], oay = o[1] - packet.ay[lane], oaz = o[2] - packet.az[lane];
+        float baba = bax*bax + bay*bay + baz*baz;
+        float bard = bax*d[0] + bay*d[1] + baz*d[2];
+        float baoa = bax*oax + bay*oay + baz*oaz;
+        float rdoa = d[0]*oax + d[1]*oay + d[2]*oaz;
+        float oaoa = oax*oax + oay*oay + oaz*oaz;
+        float rr = packet.r[lane] * packet.r[lane];
+
+        float qa = baba - bard*bard;
+        float qb = baba*rdoa - baoa*bard;
+        float qc = baba*oaoa - baoa*baoa - rr*baba;
+        float h = qb*qb - qa*qc;
+        if (h < 0) continue;
+
+        // Rays along the bone can only reach the cap they point at first
+        float tBody = 0, y = -bard;
+        if (qa != 0) {
+            tBody = (-qb - sqrt(h)) / qa;
+            y = baoa + tBody*bard;
+        }
+        if (qa != 0 && y > 0 && y < baba && tBody > tMin) {
+            ts[lane] = tBody;
+        } else {
+            float cx = oax, cy = oay, cz = oaz;
+            if (!(y <= 0)) { cx -= bax; cy -= bay; cz -= baz; }
+            float cb = d[0]*cx + d[1]*cy + d[2]*cz;
+            float ch = cb*cb - (cx*cx + cy*cy + cz*cz - rr);
+            if (ch <= 0) continue;
+            ts[lane] = -cb - sqrt(ch);
+            if (!(ts[lane] > tMin)) continue;
+        }
+        if (ts[lane] < tMax) mask |= 1 << lane;
+    }
+    if (mask == 0) return -1;
+#endif
+
+    int closest = -1;
+    for (int lane = 0; lane < CAPSULE_PACKET; ++lane) {
+        if (!(mask & (1 << lane))) continue;
+        if (closest < 0 || ts[lane] < ts[closest]) closest = lane;
+    }
+    t = ts[closest];
+    return closest;
+}
+
+bool SkeletonShape::intersect(Intersection& i) const {
+    if (nodes.empty()) return false;
+
+    // The kernel works in distances along a unit direction, where poses
+    // are built. placement is rigid, so distances stay the same.
+    Real length = i.ray.direction.norm();
+    Ray ray(i.ray.origin, i.ray.direction / length);
+    if (placed) ray = Ray(toPose * ray.origin, toPose.linear() * ray.direction);
+    float d[3] = {(float) ray.direction[0], (float) ray.direction[1], (float) ray.direction[2]};
+    Real tMax = i.intersected? i.t * length : REAL_MAX;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    int hitBone = -1;
+
+    while (top > 0) {
+        int n = stack[--top];
+        const Node& node = nodes[n];
+        Real tNear;
+        if (!hitsNode(boxes[n], ray, tMax, tNear)) continue;
+
+        if (node.left >= 0) {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+            continue;
+        }
+
+        // Start the ray at the box, floats lose too much over long rays
+        tNear = std::max((Real) 0, tNear);
+        Point start = ray.at(tNear);
+        float o[3] = {(float) start[0], (float) start[1], (float) start[2]};
+
+        const CapsulePacket& packet = packets[node.packet];
+        float t;
+        int lane = intersectPacket(packet, o, d, RAY_T_MIN - tNear, std::min(tMax - tNear, (Real) numeric_limits<float>::max()), t);
+        if (lane >= 0) {
+            tMax = tNear + t;
+            hitBone = packet.bone[lane];
+        }
+    }
+
+    if (hitBone < 0) return false;
+
+    i.t = tMax / length;
+    i.intersected = true;
+    i.shape = this;
+    i.primitive = hitBone;
+    return true;
+}
+
+void SkeletonShape::computeSurface(Intersection& i) const {
+    const Point& a = joints[bones[i.primitive].start];
+    const Point& b = joints[bones[i.primitive].end];
+    Point p = placed? Point(toPose * i.getPosition()) : i.getPosition();
+    Vector direction = placed? Vector(toPose.linear() * i.ray.direction) : i.ray.direction;
+
+    // Closest point on the bone
+    Vector ba = b - a;
+    Real baba = ba.squaredNorm();
+    Real s = (baba > 0)? std::max((Real) 0, std::min((Real) 1, (p - a).dot(ba) / baba)) : 0;
+    i.normal = (p - (a + s * ba)).normalized();
+
+    // Flip normal if necessary
+    if (direction.dot(i.normal) > 0) {
+        i.normal *= -1;
+    }
+
+    Vector axis = (baba > 0)? Vector(ba / sqrt(baba)) : Vector(0,0,1);
+    Vector side = axis.cross(Vector(0,0,1));
+    if (side.squaredNorm() < 0.01) side = axis.cross(Vector(0,1,0));
+    side.normalize();
+
+    i.u = s;
+    i.v = (atan2(i.normal.dot(axis.cross(side)), i.normal.dot(side)) + M_PI) / (2 * M_PI);
+
+    i.tangent = axis - i.normal * i.normal.dot(axis);
+    if (i.tangent.squaredNorm() < 1e-8) i.tangent = side;
+    i.tangent.normalize();
+    i.bitangent = i.normal.cross(i.tangent);
+
+    if (placed) {
+        i.normal = placement.linear() * i.normal;
+        i.tangent = placement.linear() * i.tangent;
+        i.bitangent = placement.linear() * i.bitangent;
+    }
+}
+
+void SkeletonShape::translate(const Vector& t) {
+    origin += t;
+    placement = Translation3D(t) * placement;
+    toPose = placement.inverse(Eigen::Isometry);
+    placed = true;
+    Shape::updateBoundingBox();
+}
+
+// About origin, where the shape is
+void SkeletonShape::rotate(const Vector& axis, const Real angle) {
+    placement = Translation3D(origin) * AngleAxis3D(angle, axis) * Translation3D(-origin) * placement;
+    toPose = placement.inverse(Eigen::Isometry);
+    placed = true;
+    Shape::updateBoundingBox();
+}
+
+AABB SkeletonShape::getBoundingBox() const {
+    if (nodes.empty()) return AABB();
+    AABB box(boxes[0].min, boxes[0].max);
+    if (!placed) return box;
+
+    AABB out;
+    for (int c = 0; c < 8; ++c) out.extend(Point(placement * box.corner((AABB::CornerType) c)));
+    return out;
+}
@@ -0,0 +1,144 @@
+#ifndef SKELETONSHAPE_H
+#define SKELETONSHAPE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SETTINGS.hpp"
+#include "shape.hpp"
+
+#include "Mocap/skeleton.h"
+#include "Mocap/displaySkeleton.h"
+#include "Mocap/motion.h"
+
+using namespace std;
+
+// Bones tested together by the capsule kernel
+#define CAPSULE_PACKET 4
+
+// A mocap character as a single shape: one capsule per bone, running between
+// two shared joints. Bones are grouped into packets of CAPSULE_PACKET along
+// the hierarchy, so a limb usually lands in one packet, and the packets go
+// into a small BVH. The tree is built once from the first pose and only refit
+// as the character moves.
+//
+// Capsules are stored as floats, laid out so that a packet is tested against
+// a ray at once (with SSE where available).
+//
+// Poses can also be computed ahead of time for every mocap frame a render
+// will use (see precompute), after which changing frames only points the
+// shape at another pose.
+//
+// Poses are always built where the shape was made. Moving or turning the
+// shape afterwards only changes where they are placed in the scene, so
+// baked poses stay good.
+class SkeletonShape: public Shape {
+private:
+    struct Segment {
+        int start, end; // Joints
+    };
+
+    struct CapsulePacket {
+        float ax[CAPSULE_PACKET], ay[CAPSULE_PACKET], az[CAPSULE_PACKET];
+        float bx[CAPSULE_PACKET], by[CAPSULE_PACKET], bz[CAPSULE_PACKET];
+        float r[CAPSULE_PACKET];
+        int bone[CAPSULE_PACKET]; // -1 for unused lanes
+    };
+
+    struct Node {
+        int left, right; // Children, -1 for leaves
+        int packet;      // Only set for leaves
+    };
+
+    struct Box {
+        Vec3 min, max;
+    };
+
+    // Poses one after the other, each with its joints, its capsules and the
+    // boxes of every node
+    struct PoseBuffer {
+        vector<Point> joints;
+        vector<CapsulePacket> packets;
+        vector<Box> boxes;
+    };
+
+    Skeleton *skeleton;
+    Motion *motion;
+    DisplaySkeleton *displayer;
+    Real curFrameTime;
+    Vector axes;
+    Real radius;
+
+    Point base; // Where poses are built, origin as made
+    Affine3D placement, toPose; // From where poses are built to the scene and back
+    bool placed; // Whether placement is more than the identity
+
+    vector<Affine3D> transforms; // Bone frames of the current pose
+    vector<Segment> bones; // Indexed like the skeleton, bones[0] is unused
+    vector<int> order;  // Bones depth first, skipping the root
+    vector<Node> nodes;
+
+    PoseBuffer live;        // A single pose, computed on demand
+    PoseBuffer baked;          // See precompute()
+    map<Real, int> bakedSlots; // Pose in baked for each frame time
+
+    // The pose rays see, in live or baked. joints[i] is where bone i ends,
+    // joints[0] is the root.
+    Point* joints;
+    CapsulePacket* packets;
+    Box* boxes;
+
+    void load(Skeleton* skeleton, Motion* motion, int initialFrame);
+    void findBones(Bone* bone, int parent);
+    void pose();
+    void show(PoseBuffer& buffer, int slot);
+    void makeLive();
+
+    // Safe to call from several threads at once
+    void poseJoints(Real time, Affine3D* transforms, Point* joints) const;
+    void poseInto(Real time, Affine3D* transforms, Point* joints, CapsulePacket* packets, Box* boxes) const;
+    void fillPackets(const Point* joints, CapsulePacket* packets) const;
+    void refit(const Point* joints, const CapsulePacket* packets, Box* boxes) const;
+
+    int build(vector<int>& packetIndices, int start, int end);
+    static bool hitsNode(const Box& box, const Ray& ray, Real tMax, Real& tNear);
+
+    // Lane of the closest hit between tMin and tMax, or -1
+    int intersectPacket(const CapsulePacket& packet, const float o[3], const float d[3], float tMin, float tMax, float& t) const;
+
+public:
+    // Mocap frame, public for animator access. Between whole frames, bones
+    // turn part way from one frame's pose to the next.
+    Real frameTime;
+
+    SkeletonShape(string skeletonFilename, string motionFilename, Material* material,
+        int initialFrame = 0, Vector axes = Vector(1,1,1), Vector origin = Vector(0,0,0), Real radius = 0.2);
+
+    // Takes ownership of an already parsed skeleton and motion (see AssetLoader)
+    SkeletonShape(Skeleton* skeleton, Motion* motion, Material* material,
+        int initialFrame = 0, Vector axes = Vector(1,1,1), Vector origin = Vector(0,0,0), Real radius = 0.2);
+
+    ~SkeletonShape();
+
+    int numBones() const { return order.size(); }
+
+    // Pose every given frame time up front, over numThreads threads (0 for
+    // one per core). Baked poses are only read afterwards.
+    void precompute(const vector<Real>& times, int numThreads = 0);
+    // Every time driver sets frameTime to between startFrame and stopFrame
+    void precompute(const ValueAnimator<Real>& driver, int startFrame, int stopFrame, int step = 1, int numThreads = 0);
+    int numPrecomputed() const { return bakedSlots.size(); }
+
+    void updatePosition();
+    void update() override { updatePosition(); }
+
+    bool intersect(Intersection& i) const;
+    void computeSurface(Intersection& i) const;
+    void translate(const Vector& t);
+    using Shape::rotate;
+    void rotate(const Vector& axis, const Real angle);
+    AABB getBoundingBox() const;
+};
+
+#endif
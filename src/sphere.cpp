@@ -17,8 +17,11 @@ bool Sphere::intersect(Intersection &intersection) const {
     // If it's zero we return false, it didn't hit
     if (discriminant < 0) return false;
 
-    Real t1 = (-b - sqrt(discriminant)) / (2 * a);
-    Real t2 = (-b + sqrt(discriminant)) / (2 * a);
+    // Stable form of the roots, avoids cancellation when b^2 >> 4ac
+    Real q = (b < 0)? -0.5 * (b - sqrt(discriminant)) : -0.5 * (b + sqrt(discriminant));
+    Real t1 = q / a;
+    Real t2 = c / q;
+    if (t1 > t2) swap(t1, t2);
 
     if (t1 > RAY_T_MIN && (!intersection.intersected || t1 < intersection.t)) {
         intersection.t = t1;
@@ -30,10 +33,15 @@ bool Sphere::intersect(Intersection &intersection) const {
 
     intersection.intersected = true;
     intersection.shape = this;
+
+    return true;
+};
+
+void Sphere::computeSurface(Intersection &intersection) const {
     intersection.normal = (intersection.getPosition() - origin).normalized();
 
     // Flip normal if necessary
-    if (intersection.ray.dir.dot(intersection.normal) > 0) {
+    if (intersection.ray.direction.dot(intersection.normal) > 0) {
         intersection.normal *= -1;
     }
 
@@ -47,9 +55,7 @@ bool Sphere::intersect(Intersection &intersection) const {
 
     intersection.tangent = up.cross(intersection.normal);
     intersection.bitangent = intersection.normal.cross(intersection.tangent);
-
-    return true;
-};
+}
 
 void Sphere::rotate(const Vector &axis, const Real angle) {
     AngleAxis3D trans(angle, axis);
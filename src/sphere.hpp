@@ -25,6 +25,7 @@ public:
     }
     ~Sphere() {};
     bool intersect(Intersection &intersection) const;
+    void computeSurface(Intersection &intersection) const;
     using Shape::rotate;
     void translate(const Vector& t);
     void rotate(const Vector& axis, const Real angle);
@@ -15,69 +15,80 @@ private:
     DisplaySkeleton *displayer;
     Material *material;
     int curFrameIdx;
-public:
-    int frameIdx; // public for animator access
+    vector<int> spheresPerBone;
+    ShapePool<Sphere> spheres; // Owns the members
+
+    void placeSphere(int index, const Point& center, Real radius, bool create) {
+        if (create) {
+            members.push_back(spheres.make(center, radius, material));
+        } else {
+            members[index]->origin = center;
+        }
+    }
+
+    void load(Skeleton* skeleton, Motion* motion, int initialFrame) {
+        this->skeleton = skeleton;
+        this->motion = motion;
 
-    SphereSkeleton(string skeletonFilename, string motionFilename, Material* material, int initialFrame = 0): material(material) {
         // DisplaySkeleton
         displayer = new DisplaySkeleton();
-
-        // Skeleton
-        skeleton = new Skeleton(skeletonFilename.c_str(), MOCAP_SCALE);
-        skeleton->setBasePosture();
         displayer->LoadSkeleton(skeleton);
-
-        // Motion
-        motion = new Motion(motionFilename.c_str(), MOCAP_SCALE, skeleton);
         displayer->LoadMotion(motion);
-        skeleton->setPosture(*(displayer->GetSkeletonMotion(0)->GetPosture(initialFrame))); // Set initial posture
+        skeleton->setPosture(motion->GetPostureView(initialFrame)); // Set initial posture
 
         curFrameIdx = frameIdx = initialFrame;
         updatePosition();
     }
 
-    void clearMembers() {
-        for (int i = 0; i < members.size(); ++i) {
-            delete members[i];
-        }
-        members.clear();
+public:
+    int frameIdx; // public for animator access
+
+    SphereSkeleton(string skeletonFilename, string motionFilename, Material* material, int initialFrame = 0): material(material) {
+        Skeleton* skeleton = new Skeleton(skeletonFilename.c_str(), MOCAP_SCALE);
+        skeleton->setBasePosture();
+        load(skeleton, new Motion(motionFilename.c_str(), MOCAP_SCALE, skeleton), initialFrame);
     }
 
+    // Takes ownership of an already parsed skeleton and motion (see AssetLoader)
+    SphereSkeleton(Skeleton* skeleton, Motion* motion, Material* material, int initialFrame = 0): material(material) {
+        load(skeleton, motion, initialFrame);
+    }
+
+    ~SphereSkeleton() {};
+
     void updatePosition() {
         // Clamp frameIdx
         if (frameIdx < 0) frameIdx = 0;
         if (frameIdx >= displayer->GetSkeletonMotion(0)->GetNumFrames()) frameIdx = displayer->GetSkeletonMotion(0)->GetNumFrames() - 1;
 
-        // printf("ASSUMING POSITION %d\n", frameIdx);
+        if (!members.empty() && frameIdx == curFrameIdx) return;
+        curFrameIdx = frameIdx;
 
         // Set posture and calculate new bone positions
-        displayer->GetSkeleton(0)->setPosture(* (displayer->GetSkeletonMotion(0)->GetPosture(frameIdx)));
+        displayer->GetSkeleton(0)->setPosture(displayer->GetSkeletonMotion(0)->GetPostureView(frameIdx));
         displayer->ComputeBonePositions(DisplaySkeleton::BONES_AND_LOCAL_FRAMES);
 
-
-        // Clear existing spheres
-        clearMembers();
-
-        // Now we create spheres in the shape of the skeleton.
-        // First grab the bone parameters:
+        // Grab the bone parameters
         vector<Matrix4>& rotations = displayer->rotations();
         vector<Matrix4>& scalings = displayer->scalings();
         vector<Vec4>& translations = displayer->translations();
         vector<float>& lengths = displayer->lengths();
 
         int numBones = rotations.size();
+        const float sphereRadius = 0.1;
+
+        // Spheres are made on the first pose and moved into place from then
+        // on, so each bone keeps the number of spheres it started with
+        bool first = members.empty();
+        int next = 0;
 
         // Now we iterate, disregarding the first bone (the origin)
         for (int i = 1; i < numBones; ++i) {
-            Matrix4& rotation = rotations[i];
-            Matrix4& scaling = scalings[i];
+            Matrix4 transform = rotations[i] * scalings[i];
             Vec4& translation = translations[i];
 
-            Vec4 leftVertex(0,0,0,1);
-            Vec4 rightVertex(0,0,lengths[i],1);
-
-            leftVertex = rotation * scaling * leftVertex + translation;
-            rightVertex = rotation * scaling * rightVertex + translation;
+            Vec4 leftVertex = transform * Vec4(0,0,0,1) + translation;
+            Vec4 rightVertex = transform * Vec4(0,0,lengths[i],1) + translation;
 
             // Get the direction we need to interpolate in
             Vector direction = (rightVertex - leftVertex).head<3>();
@@ -85,25 +96,24 @@ public:
             direction *= 1.0 / magnitude;
 
             // How many spheres, and what spacing?
-            const float sphereRadius = 0.1;
-            const int totalSpheres = magnitude / (2.0 * sphereRadius);
+            if (first) spheresPerBone.push_back(magnitude / (2.0 * sphereRadius));
+            const int totalSpheres = spheresPerBone[i - 1];
             const float rayIncrement = magnitude / (float)totalSpheres;
 
-            // Reduce dimensions after transform
-            Vector left3(leftVertex[0], leftVertex[1], leftVertex[2]);
-            Vector right3(rightVertex[0], rightVertex[1], rightVertex[2]);
-
-            // Store the endpoints
-            members.push_back(new Sphere(left3, sphereRadius, material));
-            members.push_back(new Sphere(right3, sphereRadius, material));
+            // The endpoints, then the intermediate spheres
+            Point left3 = leftVertex.head<3>();
+            Point right3 = rightVertex.head<3>();
+            placeSphere(next++, left3, sphereRadius, first);
+            placeSphere(next++, right3, sphereRadius, first);
 
-            // Store the intermediate spheres
             for (int j = 0; j < totalSpheres; j++) {
-                Point center = ((float)j + 0.5) * rayIncrement * direction + leftVertex.head<3>();
-                members.push_back(new Sphere(center, sphereRadius, material));
+                Point center = ((float)j + 0.5) * rayIncrement * direction + left3;
+                placeSphere(next++, center, sphereRadius, first);
             }
 
         }
+
+        updateBoundingBox();
     }
 
     void update() override {
@@ -0,0 +1,246 @@
+#include "temporalcache.hpp"
+#include "scene.hpp"
+#include "camera.hpp"
+#include "light.hpp"
+
+// ==================== TemporalCache ======================
+
+TemporalCache::TemporalCache(const AABB& bounds)
+    : bounds(bounds), width(0), height(0), rendered(false), allDirty(true),
+      dirtyMaterials(0), dirtyLights(0), margin(0), reused(0)
+{
+    cellSize = (bounds.max() - bounds.min()) / TEMPORAL_GRID;
+    cellSize = cellSize.cwiseMax(Vector(SURFACE_EPS, SURFACE_EPS, SURFACE_EPS));
+}
+
+uint64_t TemporalCache::bitFor(const void* p) {
+    map<const void*, int>::iterator it = bits.find(p);
+    int bit;
+    if (it == bits.end()) {
+        bit = bits.size();
+        bits[p] = bit;
+    } else {
+        bit = it->second;
+    }
+    return (uint64_t) 1 << std::min(bit, 63);
+}
+
+int TemporalCache::cellIndex(int x, int y, int z) const {
+    return x + TEMPORAL_GRID * (y + TEMPORAL_GRID * z);
+}
+
+void TemporalCache::markBox(const AABB& box) {
+    AABB grown(box.min() - Vector(margin, margin, margin), box.max() + Vector(margin, margin, margin));
+    if (!bounds.contains(grown)) dirtyCells.set(TEMPORAL_OUTSIDE);
+
+    AABB inside(grown);
+    inside.clamp(bounds);
+    if (inside.isEmpty()) return;
+
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = std::max(0, (int) floor((inside.min()[a] - bounds.min()[a]) / cellSize[a]));
+        hi[a] = std::min(TEMPORAL_GRID - 1, (int) floor((inside.max()[a] - bounds.min()[a]) / cellSize[a]));
+    }
+
+    for (int z = lo[2]; z <= hi[2]; ++z) {
+        for (int y = lo[1]; y <= hi[1]; ++y) {
+            for (int x = lo[0]; x <= hi[0]; ++x) {
+                dirtyCells.set(cellIndex(x, y, z));
+            }
+        }
+    }
+}
+
+// Mark where shape was and is now, if it moved
+void TemporalCache::markShape(const Shape* shape, map<const Shape*, AABB>& current) {
+    AABB now = shape->getBoundingBox();
+    current[shape] = now;
+
+    map<const Shape*, AABB>::iterator last = lastBounds.find(shape);
+    if (last == lastBounds.end()) {
+        markBox(now);
+    } else if (!last->second.isApprox(now)) {
+        markBox(last->second);
+        markBox(now);
+    }
+}
+
+void TemporalCache::update(const Scene* scene, const Camera* camera, int width, int height,
+    const vector<const Shape*>& movedShapes, const vector<const Material*>& changedMaterials)
+{
+    allDirty = !rendered || width != this->width || height != this->height;
+    dirtyCells.reset();
+    dirtyMaterials = 0;
+    dirtyLights = 0;
+
+    if (width != this->width || height != this->height) {
+        this->width = width;
+        this->height = height;
+        deps.assign(width * height, PixelDeps());
+        colors.assign(width * height, Color(0,0,0));
+        depths.assign(width * height, 0);
+    }
+
+    // Cameras that don't report their view are taken to move every frame
+    vector<Real> view = camera->getViewState();
+    if (view.empty() || view != lastView) allDirty = true;
+    lastView = view;
+
+    // Cached indirect light near moved shapes is gathered again, and reaches
+    // up to about twice the largest record spacing
+    margin = SURFACE_EPS;
+    if (scene->irradiance != NULL) margin += 2 * scene->irradiance->maxSpacing;
+
+    // Lights
+    const vector<Light*>& lights = scene->lights.members;
+    vector<const Light*> lightList(lights.begin(), lights.end());
+    vector<Point> centers;
+    vector<Real> powers;
+    for (size_t x = 0; x < lights.size(); ++x) {
+        centers.push_back(lights[x]->isLocal()? lights[x]->getCenter() : Point(0,0,0));
+        powers.push_back(lights[x]->getPower());
+    }
+
+    bool lightsMoved = false;
+    if (lightList != lastLights) {
+        allDirty = true;
+    } else {
+        for (size_t x = 0; x < lights.size(); ++x) {
+            if (centers[x] != lastLightCenters[x] || powers[x] != lastLightPowers[x]) {
+                dirtyLights |= bitFor(lights[x]);
+                lightsMoved = true;
+            }
+        }
+    }
+    for (size_t x = 0; x < movedShapes.size(); ++x) {
+        for (size_t l = 0; l < lights.size(); ++l) {
+            if (movedShapes[x] == lights[l]) {
+                dirtyLights |= bitFor(lights[l]);
+                lightsMoved = true;
+            }
+        }
+    }
+
+    if (lightsMoved) {
+        // Every point can pick any light from the tree, and the irradiance
+        // cache starts over when lights move
+        if (scene->lights.isSampled() || scene->irradiance != NULL) allDirty = true;
+    }
+
+    lastLights = lightList;
+    lastLightCenters = centers;
+    lastLightPowers = powers;
+
+    // Shapes that moved, appeared or disappeared
+    map<const Shape*, AABB> current;
+    const vector<Shape*>& shapes = scene->shapes.members;
+    for (size_t x = 0; x < shapes.size(); ++x) {
+        markShape(shapes[x], current);
+    }
+    for (map<const Shape*, AABB>::iterator it = lastBounds.begin(); it != lastBounds.end(); ++it) {
+        if (current.find(it->first) == current.end()) markBox(it->second);
+    }
+
+    // Shapes the animator says changed, even where their bounds didn't
+    for (size_t x = 0; x < movedShapes.size(); ++x) {
+        markBox(movedShapes[x]->getBoundingBox());
+        map<const Shape*, AABB>::iterator last = lastBounds.find(movedShapes[x]);
+        if (last != lastBounds.end()) markBox(last->second);
+        current[movedShapes[x]] = movedShapes[x]->getBoundingBox();
+    }
+
+    lastBounds = current;
+
+    for (size_t x = 0; x < changedMaterials.size(); ++x) {
+        dirtyMaterials |= bitFor(changedMaterials[x]);
+    }
+
+    rendered = true;
+    reused = 0;
+}
+
+bool TemporalCache::isDirty(int x, int y) const {
+    if (allDirty) return true;
+
+    const PixelDeps& d = deps[x + y * width];
+    return (d.cells & dirtyCells).any() || (d.materials & dirtyMaterials) || (d.lights & dirtyLights);
+}
+
+PixelDeps* TemporalCache::beginPixel(int x, int y) {
+    PixelDeps& d = deps[x + y * width];
+    d.cells.reset();
+    d.materials = 0;
+    d.lights = 0;
+    return &d;
+}
+
+void TemporalCache::store(int x, int y, const Color& color, Real depth) {
+    colors[x + y * width] = color;
+    depths[x + y * width] = depth;
+}
+
+void TemporalCache::recordRay(const Ray& ray, Real tMax, PixelDeps& deps) const {
+    Vector lo = bounds.min();
+    Vector hi = bounds.max();
+
+    // Clip to the grid
+    Real t0 = 0, t1 = tMax;
+    for (int a = 0; a < 3; ++a) {
+        if (ray.direction[a] != 0.0) {
+            Real ta = (lo[a] - ray.origin[a]) / ray.direction[a];
+            Real tb = (hi[a] - ray.origin[a]) / ray.direction[a];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        } else if (ray.origin[a] < lo[a] || ray.origin[a] > hi[a]) {
+            t1 = -1;
+        }
+    }
+
+    if (t0 > 0 || t1 < tMax) deps.cells.set(TEMPORAL_OUTSIDE);
+    if (t0 > t1) return;
+
+    // Walk the cells between t0 and t1 (Amanatides & Woo)
+    Point start = ray.at(t0);
+    int cell[3], step[3];
+    Real next[3], delta[3];
+    for (int a = 0; a < 3; ++a) {
+        cell[a] = (int) floor((start[a] - lo[a]) / cellSize[a]);
+        cell[a] = std::max(0, std::min(TEMPORAL_GRID - 1, cell[a]));
+
+        if (ray.direction[a] > 0) {
+            step[a] = 1;
+            next[a] = (lo[a] + (cell[a] + 1) * cellSize[a] - ray.origin[a]) / ray.direction[a];
+            delta[a] = cellSize[a] / ray.direction[a];
+        } else if (ray.direction[a] < 0) {
+            step[a] = -1;
+            next[a] = (lo[a] + cell[a] * cellSize[a] - ray.origin[a]) / ray.direction[a];
+            delta[a] = -cellSize[a] / ray.direction[a];
+        } else {
+            step[a] = 0;
+            next[a] = REAL_MAX;
+            delta[a] = REAL_MAX;
+        }
+    }
+
+    while (true) {
+        deps.cells.set(cellIndex(cell[0], cell[1], cell[2]));
+
+        int a = 0;
+        if (next[1] < next[a]) a = 1;
+        if (next[2] < next[a]) a = 2;
+        if (next[a] > t1) break;
+
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= TEMPORAL_GRID) break;
+        next[a] += delta[a];
+    }
+}
+
+void TemporalCache::recordMaterial(const Material* material, PixelDeps& deps) {
+    deps.materials |= bitFor(material);
+}
+
+void TemporalCache::recordLight(const Light* light, PixelDeps& deps) {
+    deps.lights |= bitFor(light);
+}
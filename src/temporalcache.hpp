@@ -0,0 +1,98 @@
+#ifndef TEMPORALCACHE_H
+#define TEMPORALCACHE_H
+
+#include "SETTINGS.hpp"
+#include "shape.hpp"
+#include <bitset>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class Scene;
+class Camera;
+class Light;
+
+using namespace std;
+
+// Cells per side of the grid rays are recorded in
+#define TEMPORAL_GRID 8
+#define TEMPORAL_CELLS (TEMPORAL_GRID * TEMPORAL_GRID * TEMPORAL_GRID)
+// Extra cell standing for everything outside the grid
+#define TEMPORAL_OUTSIDE TEMPORAL_CELLS
+
+// What a pixel's ray tree touched: the grid cells its rays (shadow rays
+// included) passed through, and the materials and lights it shaded with.
+// Materials and lights get a bit each as they are first seen, and past the
+// 63rd they share the last one.
+struct PixelDeps {
+    bitset<TEMPORAL_CELLS + 1> cells;
+    uint64_t materials;
+    uint64_t lights;
+};
+
+// Reuses pixels between animation frames. While RayTracer renders a frame,
+// every pixel records its dependencies. At the start of the next frame,
+// update() works out what changed: shapes and lights that moved, the
+// camera, and anything the animator was told changes (see
+// Animator::addAnimation). Only pixels depending on a change are traced
+// again, the rest are copied from the last frame.
+//
+// Rays are recorded in a coarse grid over bounds, which should cover the
+// part of the scene that moves. Changes outside it redo every pixel with a
+// ray leaving the grid.
+class TemporalCache {
+private:
+    AABB bounds;
+    Vector cellSize;
+
+    int width, height;
+    vector<PixelDeps> deps;
+    vector<Color> colors;
+    vector<Real> depths;
+
+    // State the last frame was rendered with
+    bool rendered;
+    vector<Real> lastView;
+    map<const Shape*, AABB> lastBounds;
+    vector<const Light*> lastLights;
+    vector<Point> lastLightCenters;
+    vector<Real> lastLightPowers;
+
+    // What changed since then
+    bool allDirty;
+    bitset<TEMPORAL_CELLS + 1> dirtyCells;
+    uint64_t dirtyMaterials;
+    uint64_t dirtyLights;
+    Real margin; // How far around moved shapes pixels are redone
+
+    map<const void*, int> bits;
+    uint64_t bitFor(const void* p);
+
+    int cellIndex(int x, int y, int z) const;
+    void markBox(const AABB& box);
+    void markShape(const Shape* shape, map<const Shape*, AABB>& bounds);
+
+public:
+    int reused; // Pixels copied in the last frame
+
+    TemporalCache(const AABB& bounds);
+
+    // Find what changed since the last frame. Call after the frame is set up
+    // and bounding boxes and lights are updated.
+    void update(const Scene* scene, const Camera* camera, int width, int height,
+        const vector<const Shape*>& movedShapes, const vector<const Material*>& changedMaterials);
+
+    bool isDirty(int x, int y) const;
+    // Clear a dirty pixel's dependencies before tracing it
+    PixelDeps* beginPixel(int x, int y);
+    void store(int x, int y, const Color& color, Real depth);
+    Color getColor(int x, int y) const { return colors[x + y * width]; }
+    Real getDepth(int x, int y) const { return depths[x + y * width]; }
+
+    // Cells a ray passes through in its first tMax units
+    void recordRay(const Ray& ray, Real tMax, PixelDeps& deps) const;
+    void recordMaterial(const Material* material, PixelDeps& deps);
+    void recordLight(const Light* light, PixelDeps& deps);
+};
+
+#endif
@@ -3,9 +3,11 @@
 
 #include "color.hpp"
 #include "image.hpp"
+#include "texturefile.hpp"
 #include "intersection.hpp"
 #include "perlin.hpp"
 #include "rtmath.hpp"
+#include <vector>
 
 class Scene;
 class Material;
@@ -13,6 +15,12 @@ class Material;
 class Texture: public Material {
 public:
     virtual Color at(Real u, Real v) const = 0;
+
+    // Look up n (u, v) pairs at once. Override where lookups batch well.
+    virtual void atBatch(const Real* u, const Real* v, Color* out, int n) const {
+        for (int k = 0; k < n; ++k) out[k] = at(u[k], v[k]);
+    }
+
     virtual Color getColor(const Intersection* i, const Scene* scene) const {
         return at(i->u, i->v);
     }
@@ -47,31 +55,54 @@ public:
 
 class PerlinTexture2D: public Texture {
 private:
-    mutable Perlin perlin;
+    Perlin perlin;
 public:
-    PerlinTexture2D(int octaves = 1, Real frequency = 1, Real amplitude = 1, Real persistence = 0.5, int seed=12345) {
-        perlin = Perlin(octaves, frequency, amplitude, persistence, seed);
-    }
+    PerlinTexture2D(int octaves = 1, Real frequency = 1, Real amplitude = 1, Real persistence = 0.5, int seed=12345)
+        : perlin(octaves, frequency, amplitude, persistence, seed) {}
 
     Color at(Real u, Real v) const {
         Real val = perlin.get2(u,v);
         return Color(val, val, val);
     }
+
+    // In chunks of PERLIN_LANES, so nothing is allocated per lookup. Single
+    // lookups, like the ones NormalMap and Mix make per hit, stay on the
+    // scalar path: putting one lookup's octaves in lanes instead came out
+    // 2-4x slower than the scalar loop for one to two octaves (about 90 vs
+    // 20-45 ns), so the lanes only pay off across several lookups.
+    void atBatch(const Real* u, const Real* v, Color* out, int n) const {
+        Real val[PERLIN_LANES];
+        for (int start = 0; start < n; start += PERLIN_LANES) {
+            int count = std::min(PERLIN_LANES, n - start);
+            perlin.get2Batch(u + start, v + start, val, count);
+            for (int k = 0; k < count; ++k) out[start + k] = Color(val[k], val[k], val[k]);
+        }
+    }
 };
 
 class PerlinTexture3D: public Texture {
 private:
-    mutable Perlin perlin;
+    Perlin perlin;
 public:
     Real zLevel = 0;
-    PerlinTexture3D(int octaves = 1, Real frequency = 1, Real amplitude = 1, Real persistence = 0.5, int seed=12345) {
-        perlin = Perlin(octaves, frequency, amplitude, persistence, seed);
-    }
+    PerlinTexture3D(int octaves = 1, Real frequency = 1, Real amplitude = 1, Real persistence = 0.5, int seed=12345)
+        : perlin(octaves, frequency, amplitude, persistence, seed) {}
 
     Color at(Real u, Real v) const {
         Real val = perlin.get(u, v, zLevel);
         return Color(val, val, val);
     }
+
+    void atBatch(const Real* u, const Real* v, Color* out, int n) const {
+        Real z[PERLIN_LANES], val[PERLIN_LANES];
+        for (int k = 0; k < PERLIN_LANES; ++k) z[k] = zLevel;
+
+        for (int start = 0; start < n; start += PERLIN_LANES) {
+            int count = std::min(PERLIN_LANES, n - start);
+            perlin.getBatch(u + start, v + start, z, val, count);
+            for (int k = 0; k < count; ++k) out[start + k] = Color(val[k], val[k], val[k]);
+        }
+    }
 };
 
 class BumpToNormal: public Texture {
@@ -83,10 +114,16 @@ public:
     BumpToNormal(Texture* tex, Real step): tex(tex), step(step) {}
 
     Color at(Real u, Real v) const {
+        // Fetch the three heights in one batch
+        Real us[3] = { u, u + step, u };
+        Real vs[3] = { v, v, v + step };
+        Color h[3];
+        tex->atBatch(us, vs, h, 3);
+
         // We'll use a RH Zup coordinate system because that's what NormalMap uses
-        Point a(u, v, tex->at(u, v).mean());
-        Point b(u + step, v, tex->at(u + step, v).mean());
-        Point c(u, v + step, tex->at(u, v + step).mean());
+        Point a(u, v, h[0].mean());
+        Point b(u + step, v, h[1].mean());
+        Point c(u, v + step, h[2].mean());
 
         Vector norm = (c-a).cross(b-a).normalized();
         norm = (norm / 2) + Vector(0.5, 0.5, 0.5);
@@ -96,16 +133,54 @@ public:
 };
 
 class ImageTexture: public Texture {
+private:
+    Image* image;
+    MappedTexture* mapped; // Set instead of image when loading a preprocessed .rtx file
+
+    // A .ppm is read from its .rtx instead when make textures has made one
+    void load(const string& filename) {
+        image = nullptr;
+        mapped = nullptr;
+        string preprocessed = MappedTexture::preprocessedFile(filename);
+        if (MappedTexture::isTextureFile(filename)) {
+            mapped = new MappedTexture(filename);
+        } else if (!preprocessed.empty()) {
+            mapped = new MappedTexture(preprocessed);
+        } else {
+            image = new Image(filename);
+        }
+    }
+
+    int getWidth() const {
+        return mapped? mapped->getWidth(level) : image->getWidth();
+    }
+
+    int getHeight() const {
+        return mapped? mapped->getHeight(level) : image->getHeight();
+    }
+
 public:
-    Image image;
     Real scale;
     bool tile;
     Color background;
+    int level = 0; // MIP level to sample, e.g. for far away or previz textures. Only .rtx files have levels.
 
-    ImageTexture(string filename): image(Image(filename)), scale(1), tile(false), background(Color::fromHex("E600FE")) {}
-    ImageTexture(string filename, Real scale, bool tile): image(Image(filename)), scale(scale), tile(tile), background(Color::fromHex("E600FE")) {}
+    ImageTexture(string filename): scale(1), tile(false), background(Color::fromHex("E600FE")) {
+        load(filename);
+    }
+    ImageTexture(string filename, Real scale, bool tile): scale(scale), tile(tile), background(Color::fromHex("E600FE")) {
+        load(filename);
+    }
     ImageTexture(string filename, Real scale, bool tile, Color background)
-        : image(Image(filename)), scale(scale), tile(tile), background(background) {}
+        : scale(scale), tile(tile), background(background) {
+        load(filename);
+    }
+    ImageTexture(const ImageTexture& other) = delete;
+
+    ~ImageTexture() {
+        delete image;
+        delete mapped;
+    }
 
     Color at(Real u, Real v) const {
         Real tu, tv;
@@ -119,7 +194,12 @@ public:
             tu = u / scale;
             tv = v / scale;
         }
-        return *image.at(tu * (image.getWidth() - 1), (1-tv) * (image.getHeight()-1));
+
+        int x = tu * (getWidth() - 1);
+        int y = (1-tv) * (getHeight() - 1);
+
+        if (mapped) return mapped->texel(level, x, y);
+        return *image->at(x, y);
     }
 
 
@@ -0,0 +1,241 @@
+#include "texturefile.hpp"
+
+#include <climits>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// ==================== Half floats ======================
+
+static uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    uint16_t sign = (x >> 16) & 0x8000;
+    int exponent = ((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+
+    if (exponent <= 0) return sign;                    // Flush denormals to zero
+    if (exponent >= 31) return sign | 0x7c00;          // Clamp to infinity
+    return sign | (exponent << 10) | (mantissa >> 13);
+}
+
+static float halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+
+    uint32_t x;
+    if (exponent == 0) {
+        x = sign;
+    } else if (exponent == 31) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static int levelDim(int dim, int level) {
+    return std::max(1, dim >> level);
+}
+
+static int tilesAcross(int dim, int tileSize) {
+    return (dim + tileSize - 1) / tileSize;
+}
+
+// Bytes a level takes up, edge tiles padded to full size
+static uint64_t levelBytes(int width, int height, int level, int tileSize, int texelBytes) {
+    uint64_t tiles = (uint64_t) tilesAcross(levelDim(width, level), tileSize) * tilesAcross(levelDim(height, level), tileSize);
+    return tiles * tileSize * tileSize * texelBytes;
+}
+
+// ==================== MappedTexture ======================
+
+MappedTexture::MappedTexture(const string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << " Could not open texture file \"" << filename.c_str() << "\" for reading." << endl;
+        cout << " Bailing ... " << endl;
+        exit(0);
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    size = st.st_size;
+
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED || size < sizeof(TextureFileHeader)) {
+        cout << " Could not map texture file \"" << filename.c_str() << "\". Bailing ... " << endl;
+        exit(0);
+    }
+
+    base = (const unsigned char*) mapping;
+    header = (const TextureFileHeader*) base;
+
+    bool valid = memcmp(header->magic, RTX_MAGIC, 4) == 0 &&
+                 header->levels > 0 && header->levels <= RTX_MAX_LEVELS &&
+                 header->width > 0 && header->height > 0 && header->width <= INT_MAX && header->height <= INT_MAX &&
+                 header->tileSize > 0 && header->tileSize <= RTX_MAX_TILE_SIZE &&
+                 (header->format == TEXEL_U8 || header->format == TEXEL_HALF);
+
+    texelBytes = (header->format == TEXEL_HALF)? 6 : 3;
+
+    // Every level has to lie inside the file, or a truncated file would be
+    // read past the end of the mapping
+    for (uint32_t l = 0; valid && l < header->levels; ++l) {
+        uint64_t offset = header->levelOffset[l];
+        uint64_t bytes = levelBytes(header->width, header->height, l, header->tileSize, texelBytes);
+        valid = offset >= sizeof(TextureFileHeader) && offset <= size && bytes <= size - offset;
+    }
+
+    if (!valid) {
+        cout << " \"" << filename.c_str() << "\" is not a valid texture file. Bailing ... " << endl;
+        exit(0);
+    }
+}
+
+MappedTexture::~MappedTexture() {
+    munmap((void*) base, size);
+}
+
+int MappedTexture::clampLevel(int level) const {
+    return std::max(0, std::min(level, (int) header->levels - 1));
+}
+
+int MappedTexture::getWidth(int level) const {
+    return levelDim(header->width, clampLevel(level));
+}
+
+int MappedTexture::getHeight(int level) const {
+    return levelDim(header->height, clampLevel(level));
+}
+
+int MappedTexture::getNumLevels() const {
+    return header->levels;
+}
+
+const unsigned char* MappedTexture::texelPtr(int level, int x, int y) const {
+    int t = header->tileSize;
+    int tile = (y / t) * tilesAcross(getWidth(level), t) + (x / t);
+    int within = (y % t) * t + (x % t);
+    return base + header->levelOffset[level] + (size_t) (tile * t * t + within) * texelBytes;
+}
+
+Color MappedTexture::texel(int level, int x, int y) const {
+    const unsigned char* p = texelPtr(clampLevel(level), x, y);
+
+    if (header->format == TEXEL_HALF) {
+        const uint16_t* h = (const uint16_t*) p;
+        return Color(halfToFloat(h[0]), halfToFloat(h[1]), halfToFloat(h[2]));
+    }
+
+    return Color(p[0] / 255.0, p[1] / 255.0, p[2] / 255.0);
+}
+
+bool MappedTexture::isTextureFile(const string& filename) {
+    string ext(".rtx");
+    return filename.size() > ext.size() &&
+           filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+string MappedTexture::preprocessedFile(const string& filename) {
+    string ext(".ppm");
+    if (filename.size() <= ext.size() || filename.compare(filename.size() - ext.size(), ext.size(), ext) != 0) {
+        return "";
+    }
+
+    string rtx = filename.substr(0, filename.size() - ext.size()) + ".rtx";
+    struct stat source, converted;
+    if (stat(rtx.c_str(), &converted) != 0) return "";
+    if (stat(filename.c_str(), &source) == 0 && source.st_mtime > converted.st_mtime) return "";
+    return rtx;
+}
+
+// Half the size of a level of width x height, each texel the mean of the
+// (up to) 2x2 texels it covers
+static vector<Color> halve(const vector<Color>& level, int width, int height) {
+    int w = std::max(1, width >> 1), h = std::max(1, height >> 1);
+    vector<Color> out(w * h);
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+            int y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+            out[y * w + x] = (level[y0 * width + x0] + level[y0 * width + x1] +
+                              level[y1 * width + x0] + level[y1 * width + x1]) / 4;
+        }
+    }
+    return out;
+}
+
+void MappedTexture::write(const Image& image, const string& filename, TexelFormat format, int tileSize) {
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RTX_MAGIC, 4);
+    header.width = image.getWidth();
+    header.height = image.getHeight();
+    header.tileSize = tileSize;
+    header.format = format;
+
+    int texelBytes = (format == TEXEL_HALF)? 6 : 3;
+
+    // Levels down to 1x1, or as many as fit in the header
+    int width = header.width, height = header.height;
+    int levels = 1;
+    while (levels < RTX_MAX_LEVELS && (levelDim(width, levels - 1) > 1 || levelDim(height, levels - 1) > 1)) {
+        ++levels;
+    }
+    header.levels = levels;
+
+    vector<Color> level(image.at(0), image.at(0) + image.getNumPixels());
+    vector<unsigned char> data;
+
+    for (int l = 0; l < levels; ++l) {
+        int w = levelDim(width, l), h = levelDim(height, l);
+        if (l > 0) level = halve(level, levelDim(width, l - 1), levelDim(height, l - 1));
+
+        size_t start = data.size();
+        header.levelOffset[l] = sizeof(header) + start;
+        data.resize(start + levelBytes(width, height, l, tileSize, texelBytes), 0);
+
+        int tx = tilesAcross(w, tileSize);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                int tile = (y / tileSize) * tx + (x / tileSize);
+                int within = (y % tileSize) * tileSize + (x % tileSize);
+                unsigned char* p = &data[start + (size_t) (tile * tileSize * tileSize + within) * texelBytes];
+
+                const Color& c = level[y * w + x];
+                for (int i = 0; i < 3; ++i) {
+                    if (format == TEXEL_HALF) {
+                        uint16_t half = floatToHalf(c[i]);
+                        memcpy(p + 2 * i, &half, sizeof(half));
+                    } else {
+                        p[i] = (unsigned char) std::max(0.0, std::min(255.0, round(c[i] * 255.0)));
+                    }
+                }
+            }
+        }
+    }
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL) {
+        cout << " Could not open file \"" << filename.c_str() << "\" for writing. Bailing ... " << endl;
+        exit(0);
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+}
@@ -0,0 +1,62 @@
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include "SETTINGS.hpp"
+#include "color.hpp"
+#include "image.hpp"
+#include <stdint.h>
+#include <string>
+
+// Preprocessed texture container (.rtx). Texels are stored tiled so a
+// texture can be mmap'd and sampled in place instead of being parsed and
+// copied at startup, followed by a MIP chain of box filtered levels, each
+// half the size of the one before. Use the ppm2rtx tool (or make textures)
+// to convert a PPM.
+
+#define RTX_MAGIC "RTX1"
+#define RTX_MAX_LEVELS 16
+#define RTX_DEFAULT_TILE_SIZE 32
+#define RTX_MAX_TILE_SIZE 4096
+
+enum TexelFormat {
+    TEXEL_U8 = 0,   // 3 x uint8, linear 0-255
+    TEXEL_HALF = 1  // 3 x IEEE half float
+};
+
+struct TextureFileHeader {
+    char magic[4];
+    uint32_t width, height;
+    uint32_t levels;
+    uint32_t tileSize;
+    uint32_t format;
+    uint64_t levelOffset[RTX_MAX_LEVELS]; // Byte offset of each level from the start of the file
+};
+
+class MappedTexture {
+private:
+    const unsigned char* base;
+    size_t size;
+    const TextureFileHeader* header;
+    int texelBytes;
+
+    int clampLevel(int level) const;
+    const unsigned char* texelPtr(int level, int x, int y) const;
+
+public:
+    MappedTexture(const std::string& filename);
+    ~MappedTexture();
+
+    int getWidth(int level = 0) const;
+    int getHeight(int level = 0) const;
+    int getNumLevels() const;
+
+    Color texel(int level, int x, int y) const;
+
+    static bool isTextureFile(const std::string& filename);
+    // The .rtx file next to a .ppm, if there is one at least as new as it,
+    // otherwise empty
+    static std::string preprocessedFile(const std::string& filename);
+    static void write(const Image& image, const std::string& filename, TexelFormat format, int tileSize = RTX_DEFAULT_TILE_SIZE);
+};
+
+#endif
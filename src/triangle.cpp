@@ -51,7 +51,6 @@ bool Triangle::intersect(Intersection &intersection) const {
         intersection.t = t;
         intersection.intersected = true;
         intersection.shape = this;
-        intersection.normal = n;
         return true;
     }
 
@@ -59,6 +58,10 @@ bool Triangle::intersect(Intersection &intersection) const {
 
 }
 
+void Triangle::computeSurface(Intersection &intersection) const {
+    intersection.normal = (b - a).cross(c - a).normalized();
+}
+
 void Triangle::rotate(const Vector &axis, const Real angle) {
     AngleAxis3D rot(angle, axis);
     a = rot * a;
@@ -17,6 +17,7 @@ public:
     };
     ~Triangle() {};
     bool intersect(Intersection &intersection) const;
+    void computeSurface(Intersection &intersection) const;
     using Shape::rotate;
     void translate(const Vector& t);
     void rotate(const Vector& axis, const Real angle);
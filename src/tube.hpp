@@ -36,40 +36,47 @@ public:
         this->u = axis.cross(v);
     }
 
-    bool intersect(Intersection &i) const {
-
-        Matrix3 rot;
-        rot << u.normalized(), axis.normalized(), u.cross(axis).normalized();
+    // Move both ends at once, e.g. to follow a bone
+    void setEndpoints(const Point& start, const Point& end, const Vector& u) {
+        origin = start;
+        axis = (end - start).normalized();
+        length = (end - start).norm();
 
-        Vector newOrigin = rot.transpose() * (i.ray.origin - origin);
-        Vector newDirection = rot.transpose() * i.ray.direction;
+        Vector v = axis.cross(u);
+        this->u = axis.cross(v);
+    }
 
-        // Now we construct a local-space ray and cylinder
-        Ray lr(newOrigin, newDirection);
+    bool intersect(Intersection &i) const {
+        // Split the ray into parts along and across the axis, which is the
+        // same as working in the tube's local frame without building it
+        Vector a_n = axis.normalized();
+        Vector o = i.ray.origin - origin;
 
-        Real dx = lr.dir.x();
-        Real dz = lr.dir.z();
-        Real ox = lr.origin.x();
-        Real oz = lr.origin.z();
+        Real oy = o.dot(a_n);
+        Real dy = i.ray.direction.dot(a_n);
+        Vector oPerp = o - oy * a_n;
+        Vector dPerp = i.ray.direction - dy * a_n;
 
-        Real a = dx * dx + dz * dz;
-        Real b = 2 * (dx * ox + dz * oz);
-        Real c = ox * ox + oz * oz - radius * radius;
+        Real a = dPerp.squaredNorm();
+        Real b = 2 * dPerp.dot(oPerp);
+        Real c = oPerp.squaredNorm() - radius * radius;
 
         Real determinant = (b*b) - 4*a*c;
 
         if (determinant < 0) return false;
 
-        Real t1 = (-b + sqrt(determinant)) / (2*a);
-        Real t2 = (-b - sqrt(determinant)) / (2*a);
+        // Stable form of the roots, avoids cancellation when b^2 >> 4ac
+        Real q = (b < 0)? -0.5 * (b - sqrt(determinant)) : -0.5 * (b + sqrt(determinant));
+        Real t1 = q / a;
+        Real t2 = c / q;
 
         if (t1 > t2) swap(t1, t2);
 
         // Real t1y = i.ray.at(t1).dot(axis) - origin.dot(axis);
         // Real t2y = i.ray.at(t2).dot(axis) - origin.dot(axis);
 
-        Real t1y = lr.at(t1).y();
-        Real t2y = lr.at(t2).y();
+        Real t1y = oy + t1 * dy;
+        Real t2y = oy + t2 * dy;
 
         Real t;
 
@@ -83,31 +90,34 @@ public:
 
         if (i.intersected && t > i.t) return false;
 
-        Vector localNormal = lr.at(t);
-        localNormal[1] = 0;
-        localNormal = rot * localNormal;
+        i.t = t;
+        i.intersected = true;
+        i.shape = this;
+
+        return true;
+
+    }
+
+    void computeSurface(Intersection &i) const {
+        Vector a_n = axis.normalized();
+        Vector localPos = i.getPosition() - origin;
+
+        Vector localNormal = localPos - localPos.dot(a_n) * a_n;
         localNormal.normalize();
 
 
         // Flip normal if necessary
-        // if (i.ray.dir.dot(i.normal) > 0) {
+        // if (i.ray.direction.dot(i.normal) > 0) {
             // localNormal *= -1;
         // }
 
-        i.t = t;
-        i.intersected = true;
-        i.shape = this;
         i.normal = localNormal;
 
-        i.u = (i.getPosition() - origin).dot(axis) / length;
+        i.u = localPos.dot(axis) / length;
         i.v = acos(localNormal.dot(u));
 
         i.tangent = axis;
         i.bitangent = i.normal.cross(i.tangent);
-
-
-        return true;
-
     }
 
     void rotate(const Vector &rAxis, const Real rAngle) {
@@ -121,7 +131,9 @@ public:
     }
 
     AABB getBoundingBox() const {
-        return AABB(origin);
+        Point end = origin + axis.normalized() * length;
+        Vector r(radius, radius, radius);
+        return AABB(origin.cwiseMin(end) - r, origin.cwiseMax(end) + r);
     }
 
 };
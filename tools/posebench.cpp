@@ -0,0 +1,106 @@
+// Microbenchmark for applying mocap poses to a skeleton, and for forward
+// kinematics over them, per character.
+//
+// Usage: posebench [characters] [skeleton.asf motion.amc]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "SETTINGS.hpp"
+#include "Mocap/skeleton.h"
+#include "Mocap/motion.h"
+#include "Mocap/displaySkeleton.h"
+
+using namespace std;
+
+// Nanoseconds per pose for one pass over every frame of every character
+template <typename F>
+static double timePoses(vector<Skeleton*>& skeletons, Motion& motion, F apply) {
+    int frames = motion.GetNumFrames();
+    int passes = 0;
+    double elapsed = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (elapsed < 0.5) {
+        for (int f = 0; f < frames; ++f) {
+            for (size_t c = 0; c < skeletons.size(); ++c) {
+                apply(*skeletons[c], (f + c * 7) % frames);
+            }
+        }
+        ++passes;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    return elapsed * 1e9 / ((double) passes * frames * skeletons.size());
+}
+
+// Nanoseconds per character to pose every character at every frame, with
+// the characters split over threads
+static double timeKinematics(vector<Skeleton*>& skeletons, Motion& motion, int threads) {
+    int frames = motion.GetNumFrames();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(thread([&skeletons, &motion, frames, threads, t]() {
+            vector<Affine3D> transforms(MAX_BONES_IN_ASF_FILE);
+            for (size_t c = t; c < skeletons.size(); c += threads) {
+                for (int f = 0; f < frames; ++f) {
+                    DisplaySkeleton::ComputeBoneTransforms(skeletons[c], motion.GetPostureView(f), &transforms[0]);
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < threads; ++t) {
+        workers[t].join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return elapsed * 1e9 / ((double) frames * skeletons.size());
+}
+
+int main(int argc, char** argv) {
+    int characters = (argc > 1)? atoi(argv[1]) : 16;
+    const char* asf = (argc > 3)? argv[2] : "data/skeleton/80.asf";
+    const char* amc = (argc > 3)? argv[3] : "data/skeleton/80_12.amc";
+    if (characters <= 0) characters = 16;
+
+    vector<Skeleton*> skeletons;
+    for (int c = 0; c < characters; ++c) {
+        skeletons.push_back(new Skeleton(asf, MOCAP_SCALE));
+        skeletons.back()->setBasePosture();
+    }
+    Motion motion(amc, MOCAP_SCALE, skeletons[0]);
+
+    printf("%d characters, %d frames, %d channels\n", characters, motion.GetNumFrames(), motion.GetNumChannels());
+
+    double expanded = timePoses(skeletons, motion, [&motion](Skeleton& s, int f) {
+        Posture posture;
+        motion.GetPosture(f, &posture);
+        s.setPosture(posture);
+    });
+    printf("expanded posture: %8.1f ns per character\n", expanded);
+
+    double view = timePoses(skeletons, motion, [&motion](Skeleton& s, int f) {
+        s.setPosture(motion.GetPostureView(f));
+    });
+    printf("posture view:     %8.1f ns per character\n", view);
+
+    double single = timeKinematics(skeletons, motion, 1);
+    printf("forward kinematics, 1 thread: %8.1f ns per character\n", single);
+
+    int threads = thread::hardware_concurrency();
+    if (threads > 1) {
+        double parallel = timeKinematics(skeletons, motion, threads);
+        printf("forward kinematics, %d threads: %7.1f ns per character\n", threads, parallel);
+    }
+
+    for (int c = 0; c < characters; ++c) {
+        delete skeletons[c];
+    }
+
+    return 0;
+}
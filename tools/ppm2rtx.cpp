@@ -0,0 +1,32 @@
+// Offline converter from PPM to the tiled .rtx texture container.
+//
+// Usage: ppm2rtx input.ppm output.rtx [u8|half] [tileSize]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "SETTINGS.hpp"
+#include "image.hpp"
+#include "texturefile.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s input.ppm output.rtx [u8|half] [tileSize]\n", argv[0]);
+        exit(0);
+    }
+
+    TexelFormat format = TEXEL_U8;
+    if (argc > 3 && strcmp(argv[3], "half") == 0) format = TEXEL_HALF;
+
+    int tileSize = (argc > 4)? atoi(argv[4]) : RTX_DEFAULT_TILE_SIZE;
+    if (tileSize <= 0 || tileSize > RTX_MAX_TILE_SIZE) tileSize = RTX_DEFAULT_TILE_SIZE;
+
+    Image image(argv[1]);
+    MappedTexture::write(image, argv[2], format, tileSize);
+
+    MappedTexture check(argv[2]);
+    printf("Wrote %s (%dx%d, %d levels)\n", argv[2], check.getWidth(), check.getHeight(), check.getNumLevels());
+
+    return 0;
+}